@@ -53,14 +53,20 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (either 4 or 8). The shared library
+ * overrides it with -DALIGNMENT=16, which mm.c also supports.
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8  
+#endif
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. Override with -DMAX_HEAP=... for larger
+ * heaps; 4 GB or more also needs -DMM_WIDE_HEADERS=1 for mm.c.
  */
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#ifndef MAX_HEAP
+#define MAX_HEAP ((size_t)20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -2,8 +2,13 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            Built with -DMEM_OS=1 it is the memlib of the shared library
+ *            instead, over real memory. Heap descriptors then live in
+ *            static slots, and it never calls malloc or stdio, since it
+ *            runs underneath them.
  */
-#include <stdio.h>
+#define _GNU_SOURCE  /* mremap */
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
@@ -14,24 +19,58 @@
 #include "config.h"
 #include "memlib.h"
 
+#ifndef MEM_OS
+#define MEM_OS 0
+#endif
+#if !MEM_OS
+#include <stdio.h>
+#endif
+
+/* advice used to give pages of free memory back without unmapping them */
+#ifdef MADV_FREE
+#define MEM_RELEASE_ADVICE MADV_FREE
+#else
+#define MEM_RELEASE_ADVICE MADV_DONTNEED
+#endif
+
+/* most heaps mem_heap_create can hand out over real memory, besides the default heap */
+#define MEM_MAX_HEAPS 64
+
+/* a simulated heap: a reserved region and a brk pointer inside it */
+struct mem_heap {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *max_addr;   /* largest legal heap address */
+    char *peak_brk;   /* highest brk since the last reset */
+    char *clean_brk;  /* highest brk ever; memory above it is still zero */
+#if MEM_OS
+    char in_use;      /* slot taken by mem_heap_create */
+#endif
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static struct mem_heap default_heap;
+#if MEM_OS
+static struct mem_heap heap_slots[MEM_MAX_HEAPS];  /* no allocator to get descriptors from */
+#endif
+
+static int heap_reserve(struct mem_heap *heap, size_t max_size);
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model. Over real memory a
+ *    failure leaves the heap empty, and every mem_sbrk fails with ENOMEM
  */
 void mem_init(void)
 {
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+#if MEM_OS
+    heap_reserve(&default_heap, MAX_HEAP);
+#else
+    if (heap_reserve(&default_heap, MAX_HEAP) < 0) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+#endif
 }
 
 /* 
@@ -39,7 +78,8 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(default_heap.start_brk, default_heap.max_addr - default_heap.start_brk);
+    default_heap.start_brk = default_heap.brk = default_heap.max_addr = NULL;
 }
 
 /*
@@ -47,25 +87,17 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_heap_reset_brk(&default_heap);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap and releases the pages it gave up.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_heap_sbrk(&default_heap, incr);
 }
 
 /*
@@ -73,7 +105,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return (void *)default_heap.start_brk;
 }
 
 /* 
@@ -81,7 +113,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(default_heap.brk - 1);
 }
 
 /*
@@ -89,7 +121,16 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_heap_size(&default_heap);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the last mem_reset_brk
+ */
+size_t mem_peak_heapsize()
+{
+    return mem_heap_peak(&default_heap);
 }
 
 /*
@@ -99,3 +140,201 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_heap_create - reserve max_size bytes of VM for a new, empty heap,
+ *    or return NULL if no descriptor or address space is left
+ */
+mem_heap_t *mem_heap_create(size_t max_size)
+{
+#if MEM_OS
+    for (int i = 0; i < MEM_MAX_HEAPS; i++) {
+	struct mem_heap *heap = &heap_slots[i];
+	if (__atomic_test_and_set(&heap->in_use, __ATOMIC_ACQUIRE))
+	    continue;
+	if (heap_reserve(heap, max_size) < 0) {
+	    __atomic_clear(&heap->in_use, __ATOMIC_RELEASE);
+	    return NULL;
+	}
+	return heap;
+    }
+    errno = ENOMEM;
+    return NULL;
+#else
+    struct mem_heap *heap;
+
+    if ((heap = (struct mem_heap *)malloc(sizeof(struct mem_heap))) == NULL)
+	return NULL;
+    if (heap_reserve(heap, max_size) < 0) {
+	free(heap);
+	return NULL;
+    }
+    return heap;
+#endif
+}
+
+/*
+ * mem_heap_destroy - release a heap created by mem_heap_create
+ */
+void mem_heap_destroy(mem_heap_t *heap)
+{
+    munmap(heap->start_brk, heap->max_addr - heap->start_brk);
+#if MEM_OS
+    __atomic_clear(&heap->in_use, __ATOMIC_RELEASE);
+#else
+    free(heap);
+#endif
+}
+
+/*
+ * mem_heap_default - return the heap used by mem_sbrk and friends
+ */
+mem_heap_t *mem_heap_default(void)
+{
+    return &default_heap;
+}
+
+/*
+ * mem_heap_sbrk - mem_sbrk for an arbitrary heap
+ */
+void *mem_heap_sbrk(mem_heap_t *heap, intptr_t incr)
+{
+    char *old_brk = heap->brk;
+
+    if (incr < 0) {
+	if (-incr > heap->brk - heap->start_brk) {
+	    errno = EINVAL;
+	    return (void *)-1;
+	}
+	heap->brk += incr;
+	mem_release(heap->brk, -incr);
+	return (void *)old_brk;
+    }
+    if (incr > heap->max_addr - heap->brk) {
+	errno = ENOMEM;
+#if !MEM_OS
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#endif
+	return (void *)-1;
+    }
+    heap->brk += incr;
+    if (heap->brk > heap->peak_brk)
+	heap->peak_brk = heap->brk;
+    if (heap->brk > heap->clean_brk)
+	heap->clean_brk = heap->brk;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_reset_brk - mem_reset_brk for an arbitrary heap
+ */
+void mem_heap_reset_brk(mem_heap_t *heap)
+{
+    heap->brk = heap->start_brk;
+    heap->peak_brk = heap->start_brk;
+}
+
+/*
+ * mem_heap_base - return address of the first byte of a heap
+ */
+void *mem_heap_base(mem_heap_t *heap)
+{
+    return (void *)heap->start_brk;
+}
+
+/*
+ * mem_heap_limit - return the address one past the last byte a heap may grow to
+ */
+void *mem_heap_limit(mem_heap_t *heap)
+{
+    return (void *)heap->max_addr;
+}
+
+/*
+ * mem_heap_size - return the current size of a heap in bytes
+ */
+size_t mem_heap_size(mem_heap_t *heap)
+{
+    return (size_t)(heap->brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_peak - mem_peak_heapsize for an arbitrary heap
+ */
+size_t mem_heap_peak(mem_heap_t *heap)
+{
+    return (size_t)(heap->peak_brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_clean - return the lowest address of a heap that has never
+ *    been below its brk, so everything from there up still reads as zero
+ */
+void *mem_heap_clean(mem_heap_t *heap)
+{
+    return (void *)heap->clean_brk;
+}
+
+/*
+ * mem_release - give the whole pages inside [p, p + size) back to the
+ *    system and return how many bytes that was. With MADV_FREE the
+ *    kernel reclaims them lazily and a later write cancels that, so
+ *    their contents are undefined afterwards
+ */
+size_t mem_release(void *p, size_t size)
+{
+    uintptr_t page = (uintptr_t)mem_pagesize();
+    uintptr_t lo = ((uintptr_t)p + page - 1) & ~(page - 1);
+    uintptr_t hi = ((uintptr_t)p + size) & ~(page - 1);
+
+    if (hi <= lo || madvise((void *)lo, hi - lo, MEM_RELEASE_ADVICE) < 0)
+	return 0;
+    return hi - lo;
+}
+
+/*
+ * mem_map - map size bytes of zeroed memory outside of any heap, or
+ *    return NULL on failure
+ */
+void *mem_map(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*
+ * mem_unmap - release a mapping made by mem_map or mem_remap
+ */
+void mem_unmap(void *p, size_t size)
+{
+    munmap(p, size);
+}
+
+/*
+ * mem_remap - resize a mapping made by mem_map, moving it if needed.
+ *    Returns the new address, or NULL (leaving the old mapping intact)
+ */
+void *mem_remap(void *p, size_t old_size, size_t new_size)
+{
+    void *q = mremap(p, old_size, new_size, MREMAP_MAYMOVE);
+    return (q == MAP_FAILED) ? NULL : q;
+}
+
+/*
+ * heap_reserve - map the storage that models the available VM for one heap
+ */
+static int heap_reserve(struct mem_heap *heap, size_t max_size)
+{
+    void *start = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED)
+	return -1;
+
+    heap->start_brk = (char *)start;
+    heap->max_addr = heap->start_brk + max_size;  /* max legal heap address */
+    heap->brk = heap->start_brk;                  /* heap is empty initially */
+    heap->peak_brk = heap->start_brk;
+    heap->clean_brk = heap->start_brk;
+    return 0;
+}
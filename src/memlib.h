@@ -1,11 +1,37 @@
+#include <stdint.h>
 #include <unistd.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
+/*
+ * Independent heaps, each with its own brk inside a separately reserved region.
+ * The functions above operate on the default heap.
+ */
+typedef struct mem_heap mem_heap_t;
+
+mem_heap_t *mem_heap_create(size_t max_size);
+void mem_heap_destroy(mem_heap_t *heap);
+mem_heap_t *mem_heap_default(void);
+void *mem_heap_sbrk(mem_heap_t *heap, intptr_t incr);
+void mem_heap_reset_brk(mem_heap_t *heap);
+void *mem_heap_base(mem_heap_t *heap);
+void *mem_heap_limit(mem_heap_t *heap);
+size_t mem_heap_size(mem_heap_t *heap);
+size_t mem_heap_peak(mem_heap_t *heap);
+void *mem_heap_clean(mem_heap_t *heap);
+size_t mem_release(void *p, size_t size);
+
+/*
+ * Mappings outside of any heap, for blocks too large to carve from one
+ */
+void *mem_map(size_t size);
+void mem_unmap(void *p, size_t size);
+void *mem_remap(void *p, size_t old_size, size_t new_size);
@@ -1,14 +1,77 @@
-
 #include "mm.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "config.h"
 #include "memlib.h"
+#include "mm_copy.h"
+
+// Build with -DMM_THREAD_SAFE=1 to share the allocator between threads
+#ifndef MM_THREAD_SAFE
+#define MM_THREAD_SAFE 0
+#endif
+
+#if MM_THREAD_SAFE
+#include <pthread.h>
+#endif
+
+// Free block index: segregated lists searched first fit, or two-level segregated fit (TLSF)
+#define MM_ENGINE_SEGREGATED 0
+#define MM_ENGINE_TLSF 1
+#ifndef MM_ENGINE
+#define MM_ENGINE MM_ENGINE_SEGREGATED
+#endif
+
+// Serve requests of up to 48 bytes from header-free, page-sized slabs
+#ifndef MM_SLAB
+#define MM_SLAB 1
+#endif
+
+// Build with -DMM_WIDE_HEADERS=1 for 64-bit block headers, needed for heaps of 4 GB or more
+#ifndef MM_WIDE_HEADERS
+#define MM_WIDE_HEADERS 0
+#endif
+
+// Free-list links are 32-bit offsets from the heap base, which shrinks the minimum block to 16
+// bytes; -DMM_COMPACT_LINKS=0 stores full pointers. Wide headers gain nothing from it.
+#ifndef MM_COMPACT_LINKS
+#define MM_COMPACT_LINKS (!MM_WIDE_HEADERS)
+#endif
+
+// Requests of at least this many bytes get a mapping of their own instead of heap space; 0
+// turns this off, which mdriver needs since it expects every payload inside the simulated heap
+#ifndef MM_MMAP_THRESHOLD
+#define MM_MMAP_THRESHOLD 0
+#endif
+
+// Once a free block at the end of a heap reaches MM_TRIM_THRESHOLD bytes the heap is shrunk,
+// keeping MM_TRIM_PAD bytes of it; free blocks of MM_RELEASE_THRESHOLD bytes elsewhere give
+// their interior pages back to the system. 0 turns either policy off.
+#ifndef MM_TRIM_THRESHOLD
+#define MM_TRIM_THRESHOLD (128 * 1024)
+#endif
+#ifndef MM_TRIM_PAD
+#define MM_TRIM_PAD (64 * 1024)
+#endif
+#ifndef MM_RELEASE_THRESHOLD
+#define MM_RELEASE_THRESHOLD (256 * 1024)
+#endif
+
+// Blocks grown by realloc get slack after them so that further growth needs no copy
+#ifndef MM_REALLOC_HEADROOM
+#define MM_REALLOC_HEADROOM 1
+#endif
+
+// Number of independent heaps (arenas) threads are spread over in thread-safe mode
+#ifndef MM_NUM_HEAPS
+#define MM_NUM_HEAPS 8
+#endif
 
 team_t team = {
     /* Team name */
@@ -22,90 +85,383 @@ team_t team = {
     /* Second member's email address (leave blank if none) */
     ""};
 
-#define WSIZE 4               // word size
-#define DSIZE 8               // double word size
+// A header or footer word holds a block size and the alloc bits
+#if MM_WIDE_HEADERS
+typedef uint64_t word_t;
+#define WSIZE 8                                      // word size
+#define WORD_MAX UINT64_MAX
+#define WORD_FLS(x) (63 - __builtin_clzll(x))  // index of the highest set bit
+#define WORD_FFS(x) __builtin_ctzll(x)         // index of the lowest set bit
+#else
+typedef uint32_t word_t;
+#define WSIZE 4  // word size
+#define WORD_MAX UINT32_MAX
+#define WORD_FLS(x) (31 - __builtin_clz(x))
+#define WORD_FFS(x) __builtin_ctz(x)
+#endif
+#define DSIZE (2 * WSIZE)     // double word size
 #define CHUNK_SIZE (1 << 12)  // amount to extend heap by
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-// pack size and allocated bit into a word
+// pack size and allocated bits into a word
 #define PACK(size, alloc) ((size) | (alloc))
 
+// header bits: this block is allocated, the block before it is allocated, the block is mapped
+#define ALLOC 0x1
+#define PREV_ALLOC 0x2
+#define MMAPPED 0x4
+
 // read and write a ptr at p
 #define GET_PTR(p) (*((void **)(p)))
 #define PUT_PTR(p, v) (*((void **)(p))) = (v)
 
-// read word and write a word at p
-#define GET(p) (*(uint32_t *)(p))
-#define PUT(p, val) (*(uint32_t *)(p) = (val))
+// read word and write a word at p; with several threads a header is read without its heap's
+// lock (free, realloc, the thread cache) while a neighbor's free flips its PREV_ALLOC bit under
+// the lock, so header words are accessed atomically (plain moves on x86 and ARM)
+#if MM_THREAD_SAFE
+#define GET(p) __atomic_load_n((word_t *)(p), __ATOMIC_RELAXED)
+#define PUT(p, val) __atomic_store_n((word_t *)(p), (val), __ATOMIC_RELAXED)
+#else
+#define GET(p) (*(word_t *)(p))
+#define PUT(p, val) (*(word_t *)(p) = (val))
+#endif
 
-// get size and alloc bit from header/footer at p
-#define GET_SIZE(p) (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
+// get size and alloc bits from header/footer at p
+#define GET_SIZE(p) (GET(p) & ~(word_t)0x7)
+#define GET_ALLOC(p) (GET(p) & ALLOC)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define GET_MMAPPED(p) (GET(p) & MMAPPED)
 
-// returns the header or footer pointer from a bp
-#define HEADER_PTR(bp) ((uint32_t *)((char *)(bp) - WSIZE))
-#define FOOTER_PTR(bp) ((uint32_t *)((char *)(bp) + (GET_SIZE(HEADER_PTR(bp)) - DSIZE)))
+// set or clear the prev-alloc bit in the header at p
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
 
-// returns a pointer to the pointer of the next/prev free block
-#define NEXT_FREE_PTR(bp) ((uintptr_t *)(bp))
-#define PREV_FREE_PTR(bp) ((uintptr_t *)(bp) + 1)
+// returns the header or footer pointer from a bp; only free blocks have a footer
+#define HEADER_PTR(bp) ((word_t *)((char *)(bp) - WSIZE))
+#define FOOTER_PTR(bp) ((word_t *)((char *)(bp) + (GET_SIZE(HEADER_PTR(bp)) - DSIZE)))
 
-// returns a pointer to the next or previous block
+// read and write a free-list link at p of a block in heap h; a compact link is the offset from
+// the heap base, which no block starts at, so 0 stands for NULL
+#if MM_COMPACT_LINKS
+typedef uint32_t link_t;
+#define GET_LINK(h, p) (*(link_t *)(p) != 0 ? (void *)((h)->lo + *(link_t *)(p)) : NULL)
+#define PUT_LINK(h, p, v) (*(link_t *)(p) = link_offset(h, v))
+#else
+typedef void *link_t;
+#define GET_LINK(h, p) ((void)(h), GET_PTR(p))
+#define PUT_LINK(h, p, v) ((void)(h), PUT_PTR(p, v))
+#endif
+
+// returns a pointer to the link to the next/prev free block
+#define NEXT_FREE_PTR(bp) ((link_t *)(bp))
+#define PREV_FREE_PTR(bp) ((link_t *)(bp) + 1)
+
+// returns a pointer to the next or previous block; the previous one must be free
 #define NEXT_BLOCK_PTR(bp) ((void *)((char *)(bp) + GET_SIZE(HEADER_PTR(bp))))
 #define PREV_BLOCK_PTR(bp) ((void *)((char *)(bp) - GET_SIZE((char *)bp - DSIZE)))
 
+#ifndef ALIGNMENT
 #define ALIGNMENT DSIZE
+#endif
 
 // rounds up to the nearest multiple of ALIGNMENT
-#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+#define MIN_BLOCK_SIZE ALIGN(DSIZE + 2 * sizeof(link_t))
+
+// block size needed to hold a payload of size bytes, which may run over the footer slot
+#define ADJUST_SIZE(size) MAX(ALIGN((size) + WSIZE), MIN_BLOCK_SIZE)
+
+// largest request whose block size still fits in a header word
+#define MAX_REQUEST ((size_t)(WORD_MAX / 2))
+
+// Mapped blocks: the mapping length, the bytes of the mapping in front of it (only aligned blocks
+// have any), then the header word right before the payload
+#define HUGE_OFFSET ALIGN(2 * sizeof(size_t) + WSIZE)
+#define HUGE_LENGTH(bp) (*(size_t *)((char *)(bp) - HUGE_OFFSET))
+#define HUGE_LEAD(bp) (*(size_t *)((char *)(bp) - HUGE_OFFSET + sizeof(size_t)))
+#define HUGE_START(bp) ((char *)(bp) - HUGE_OFFSET - HUGE_LEAD(bp))
+
+_Static_assert(MM_WIDE_HEADERS || MAX_HEAP < (1ull << 32),
+               "heaps of 4 GB or more need MM_WIDE_HEADERS");
+_Static_assert(!MM_COMPACT_LINKS || MAX_HEAP < (1ull << 32),
+               "heaps of 4 GB or more need MM_COMPACT_LINKS=0");
+_Static_assert(MM_ALIGNMENT == ALIGNMENT && MM_HEADER_SIZE == WSIZE,
+               "the block layout in mm.h must match mm.c");
+
+// Segregated lists: one list per ALIGNMENT bytes up to EXACT_LIST_MAX, then one per power of two
+// up to 2^TREE_MIN_LOG2; larger blocks are kept in a size-ordered tree instead
+#define EXACT_LIST_MAX_LOG2 6
+#define EXACT_LIST_MAX (1 << EXACT_LIST_MAX_LOG2)
+#define EXACT_LISTS ((int)((EXACT_LIST_MAX - MIN_BLOCK_SIZE) / ALIGNMENT) + 1)
+#define TREE_MIN_LOG2 14
+#define NUM_LISTS (EXACT_LISTS + TREE_MIN_LOG2 - EXACT_LIST_MAX_LOG2 + 1)
+#define TREE_LIST (NUM_LISTS - 1)
+
+// children of a block in the large-block tree, stored in the free-list link words
+#define TREE_LEFT(bp) NEXT_FREE_PTR(bp)
+#define TREE_RIGHT(bp) PREV_FREE_PTR(bp)
+
+// TLSF: first level splits sizes by power of two, second level splits each range linearly
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + 3)  // sizes below 2^shift share first level 0
+#define FL_INDEX_COUNT (8 * WSIZE - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT)
+
+// Slabs: a page of same-sized objects without boundary tags, found by masking the address
+#define SLAB_SIZE 4096
+#define SLAB_MAX_SIZE MM_SLAB_MAX_SIZE  // 48 bytes
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+#define SLAB_CLASS(size) (ALIGN(size) / ALIGNMENT - 1)
+#define SLAB_MAP_WORDS ((SLAB_SIZE / ALIGNMENT + 63) / 64)
+#define SLAB_BLOCK_SIZE ADJUST_SIZE(SLAB_SIZE)  // heap block that holds one slab
+#define SLAB_PAGE_WORDS ((MAX_HEAP / SLAB_SIZE + 63) / 64)
+
+typedef struct slab
+{
+    struct slab *next;  // partial slabs of the same class
+    struct slab *prev;
+    uint32_t obj_size;
+    uint32_t capacity;
+    uint32_t free_count;
+    uint64_t free_map[SLAB_MAP_WORDS];  // bit i is set while object i is free
+} slab_t;
+
+#define SLAB_OBJECTS ALIGN(sizeof(slab_t))  // offset of the first object in a slab
+
+// Realloc headroom: a block that grows gets 1/2^shift of its size as slack. Every window of
+// grants, the shift moves toward less slack when few grants absorbed a later growth, and toward
+// more when each one did.
+#define HEADROOM_SLOTS 4       // recently grown blocks remembered per heap
+#define HEADROOM_WINDOW 64     // grants between adjustments of the shift
+#define HEADROOM_MIN_SHIFT 1   // at most half the block size
+#define HEADROOM_MAX_SHIFT 6   // at least 1/64 of the block size
+#define HEADROOM_START_SHIFT 2
+
+typedef struct
+{
+    void *bp;      // block handed out with slack
+    word_t block;  // its block size, to tell a reused address apart
+    word_t asize;  // adjusted size it was last grown to
+} headroom_t;
+
+/*
+ * A heap (arena): its own segregated lists, prologue/epilogue and memlib region. Without
+ * MM_THREAD_SAFE there is exactly one, backed by the default memlib heap.
+ */
+typedef struct
+{
+#if MM_ENGINE == MM_ENGINE_TLSF
+    void *tlsf_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+    word_t fl_bitmap;                    // bit f is set while sl_bitmap[f] is non-zero
+    uint32_t sl_bitmap[FL_INDEX_COUNT];  // bit s is set while tlsf_lists[f][s] is non-empty
+#else
+    void *segregated_lists[NUM_LISTS];
+    uint32_t nonempty_lists;  // bit i is set while segregated_lists[i] is non-empty
+#endif
+#if MM_SLAB
+    slab_t *partial_slabs[SLAB_CLASSES];    // slabs with at least one free object
+    uint64_t slab_pages[SLAB_PAGE_WORDS];  // bit i is set while page i of the region is a slab
+#endif
+    void *heap_list_ptr;
+    mem_heap_t *mem;
+    char *lo;  // reserved address range [lo, hi) of mem, used to find a block's owner
+    char *hi;
+    char *clean_lo;  // no block at or above this has been handed out; only free tags are non-zero
+#if MM_REALLOC_HEADROOM
+    headroom_t grown[HEADROOM_SLOTS];  // blocks that were given slack, replaced round-robin
+    uint32_t grown_next;
+    uint32_t headroom_shift;
+    uint32_t headroom_grants;  // slack handed out in the current window
+    uint32_t headroom_hits;    // growths the slack absorbed without a copy
+#endif
+    int ready;  // prologue and first free block are in place
+#if MM_THREAD_SAFE
+    pthread_mutex_t lock;
+    void *remote_free;  // blocks freed by threads of other heaps, linked through their payloads
+#endif
+} heap_t;
+
+#if MM_THREAD_SAFE
+#define NUM_HEAPS MM_NUM_HEAPS
+#else
+#define NUM_HEAPS 1
+#endif
+
+#if MM_THREAD_SAFE
+static heap_t heaps[NUM_HEAPS] = {[0 ... NUM_HEAPS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER}};
+
+#define LOCK(h) pthread_mutex_lock(&(h)->lock)
+#define UNLOCK(h) pthread_mutex_unlock(&(h)->lock)
+
+// Per-thread cache of freed blocks for the exact classes up to 64 and the 128/256 bins, followed
+// by one class per slab object size
+#define TCACHE_CLASSES (EXACT_LISTS + 2)
+#if MM_SLAB
+#define TCACHE_SLOTS (TCACHE_CLASSES + SLAB_CLASSES)
+#else
+#define TCACHE_SLOTS TCACHE_CLASSES
+#endif
+#define TCACHE_MAX_COUNT 32  // blocks per class before half the class is flushed
+#define TCACHE_REFILL 8      // blocks fetched per lock acquisition on an exact-class miss
+
+typedef struct
+{
+    void *head[TCACHE_SLOTS];
+    uint32_t count[TCACHE_SLOTS];
+    uint32_t epoch;
+    int registered;
+} tcache_t;
+
+static __thread tcache_t tcache;
+static __thread heap_t *thread_heap;
+static uint32_t next_heap;   // round-robin counter for assigning threads to heaps
+static uint32_t heap_epoch;  // bumped by mm_init so caches from an old heap are dropped
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+#else
+static heap_t heaps[NUM_HEAPS];
 
-#define MIN_BLOCK_SIZE ALIGN(DSIZE + 2 * sizeof(void *))
+#define LOCK(h) ((void)(h))
+#define UNLOCK(h) ((void)(h))
+#endif
 
-#define NUM_LISTS 15
-static void *segregated_lists[NUM_LISTS];
+static int heap_init(heap_t *h);
+static heap_t *heap_for_thread(void);
+#if MM_THREAD_SAFE
+static int heap_prepare(heap_t *h);
+#endif
+static void *malloc_fallback(heap_t *full, size_t alignment, size_t size);
+static heap_t *heap_of(void *bp);
+static int heap_trim(heap_t *h, size_t pad);
+static size_t release_block(void *bp);
+static void scrub_tag(heap_t *h, word_t *p);
+static void sort_ptrs(void **a, size_t n);
+static void sift_down(void **a, size_t i, size_t n);
 
-static void *heap_list_ptr;
+#if MM_REALLOC_HEADROOM
+static size_t headroom_request(heap_t *h, size_t size);
+static void headroom_grant(heap_t *h, void *bp, word_t asize);
+static headroom_t *headroom_find(heap_t *h, void *bp, word_t block);
+#endif
 
-static void *extend_heap(uint32_t words);
-static void *coalesce(void *bp);
-static void place(void *bp, uint32_t size);
+#if MM_MMAP_THRESHOLD > 0
+static void *huge_alloc(size_t size, size_t alignment);
+static void huge_free(void *bp);
+static void *huge_realloc(void *bp, size_t size);
+#endif
 
-static void *first_fit(uint32_t size);
+static void *extend_heap(heap_t *h, size_t words);
+static void *extend_to(heap_t *h, word_t size);
+static void *coalesce(heap_t *h, void *bp);
+static void place(heap_t *h, void *bp, word_t size);
+static void *place_at(heap_t *h, void *bp, char *p, word_t size);
 
-static int get_list_index(uint32_t size);
-static void insert_free(void *bp);
-static void remove_free(void *bp);
-static void *next_free(void *bp);
-static void *prev_free(void *bp);
+#if MM_ENGINE == MM_ENGINE_TLSF
+static void *good_fit(heap_t *h, word_t size);
+#define find_fit good_fit
+#else
+static void *first_fit(heap_t *h, word_t size);
+#define find_fit first_fit
+static int tree_less(void *a, void *b);
+static uint32_t tree_priority(void *bp);
+static void *tree_insert(heap_t *h, void *root, void *bp);
+static void *tree_delete(heap_t *h, void *root, void *bp);
+static void *tree_merge(heap_t *h, void *left, void *right);
+static void *tree_best_fit(heap_t *h, void *root, word_t size);
+#endif
 
-static void print_heap_list();
-static void print_free_list(void *free_list_ptr);
-static void print_segregated_lists();
+static void *heap_malloc(heap_t *h, size_t size);
+#if MM_THREAD_SAFE
+static void heap_free(heap_t *h, void *bp);
+#endif
+static void free_tagged(heap_t *h, void *bp);
+static void *malloc_block(heap_t *h, word_t size);
+static size_t malloc_run(heap_t *h, word_t size, size_t n, void **out);
+static void *malloc_aligned(heap_t *h, size_t alignment, word_t size);
+static void free_block(heap_t *h, void *bp);
+
+#if MM_SLAB
+static slab_t *slab_of(heap_t *h, void *bp);
+static slab_t *slab_create(heap_t *h, uint32_t obj_size);
+static void *slab_alloc(heap_t *h, size_t size);
+static void slab_free(heap_t *h, slab_t *slab, void *bp);
+static void slab_link(heap_t *h, slab_t *slab);
+static void slab_unlink(heap_t *h, slab_t *slab);
+#endif
+
+#if MM_THREAD_SAFE
+static tcache_t *tcache_acquire(void);
+static int tcache_index(size_t size);
+static void *tcache_get(size_t size);
+static void tcache_put(void *bp, int idx);
+static void tcache_flush(tcache_t *cache, int idx, uint32_t keep);
+static void tcache_destroy(void *arg);
+static void tcache_make_key(void);
+static void remote_push(heap_t *h, void *first, void *last);
+static void remote_drain(heap_t *h);
+static void atfork_register(void);
+static void fork_prepare(void);
+static void fork_parent(void);
+static void fork_child(void);
+#endif
+
+#if MM_ENGINE == MM_ENGINE_TLSF
+static void tlsf_mapping(word_t size, int *fl, int *sl);
+#endif
+#if MM_ENGINE == MM_ENGINE_SEGREGATED || MM_THREAD_SAFE
+static int get_list_index(word_t size);
+#endif
+#if MM_COMPACT_LINKS
+static link_t link_offset(heap_t *h, void *bp);
+#endif
+static void list_push(heap_t *h, void **head, void *bp);
+static int list_remove(heap_t *h, void **head, void *bp);
+static void insert_free(heap_t *h, void *bp);
+static void remove_free(heap_t *h, void *bp);
+static void *next_free(heap_t *h, void *bp);
+static void *prev_free(heap_t *h, void *bp);
+
+// Debugging aids, called by hand from a debugger
+__attribute__((unused)) static void print_heap_list(heap_t *h);
+static void print_free_list(heap_t *h, void *free_list_ptr);
+#if MM_ENGINE == MM_ENGINE_TLSF
+__attribute__((unused)) static void print_tlsf_lists(heap_t *h);
+#else
+static void print_tree(heap_t *h, void *root);
+__attribute__((unused)) static void print_segregated_lists(heap_t *h);
+#endif
 
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
-    // Initialize segregated lists
-    for (int i = 0; i < NUM_LISTS; ++i)
+    heap_t *h = &heaps[0];
+#if MM_THREAD_SAFE
+    pthread_once(&atfork_once, atfork_register);
+    __atomic_add_fetch(&heap_epoch, 1, __ATOMIC_RELEASE);
+
+    // Secondary heaps are owned by the allocator, so start them over here as well
+    for (int i = 1; i < NUM_HEAPS; ++i)
     {
-        segregated_lists[i] = NULL;
+        LOCK(&heaps[i]);
+        if (heaps[i].mem != NULL) mem_heap_reset_brk(heaps[i].mem);
+        __atomic_store_n(&heaps[i].ready, 0, __ATOMIC_RELAXED);
+        heaps[i].remote_free = NULL;
+        UNLOCK(&heaps[i]);
     }
+#endif
 
-    // Initialize start of heap
-    heap_list_ptr = mem_sbrk(4 * WSIZE);
-    if (heap_list_ptr == (void *)-1) return -1;
-    PUT(heap_list_ptr, 0);                             // 4 byte padding word
-    PUT(heap_list_ptr + WSIZE, PACK(DSIZE, 1));        // prologue header
-    PUT(heap_list_ptr + (2 * WSIZE), PACK(DSIZE, 1));  // prologue footer
-    PUT(heap_list_ptr + (3 * WSIZE), PACK(0, 1));      // epilogue
-    heap_list_ptr += (2 * WSIZE);
-
-    // Add first free block
-    if (extend_heap(CHUNK_SIZE / WSIZE) == NULL) return -1;
-    return 0;
+    LOCK(h);
+    h->mem = mem_heap_default();
+    int status = heap_init(h);
+    UNLOCK(h);
+    return status;
 }
 
 /*
@@ -115,22 +471,20 @@ void *mm_malloc(size_t size)
 {
     if (size == 0) return NULL;
 
-    uint32_t aligned_size = MAX(DSIZE + ALIGN(size), MIN_BLOCK_SIZE);
-    void *bp = first_fit(aligned_size);
-
-    if (bp != NULL)
-    {
-        remove_free(bp);
-        place(bp, aligned_size);
-        return bp;
-    }
+#if MM_MMAP_THRESHOLD > 0
+    if (size >= MM_MMAP_THRESHOLD) return huge_alloc(size, 0);
+#endif
+#if MM_THREAD_SAFE
+    void *cached = tcache_get(size);
+    if (cached != NULL) return cached;
+#endif
 
-    // No space found, extend heap
-    uint32_t extend_size = MAX(CHUNK_SIZE, aligned_size);
-    if ((bp = extend_heap(extend_size / WSIZE)) == NULL) return NULL;
-    remove_free(bp);
-    place(bp, aligned_size);
-    return bp;
+    heap_t *h = heap_for_thread();
+    if (h == NULL) return malloc_fallback(NULL, 0, size);
+    LOCK(h);
+    void *bp = heap_malloc(h, size);
+    UNLOCK(h);
+    return bp != NULL ? bp : malloc_fallback(h, 0, size);
 }
 
 /*
@@ -138,274 +492,1659 @@ void *mm_malloc(size_t size)
  */
 void mm_free(void *ptr)
 {
-    // Make sure pointer is valid
     if (ptr == NULL) return;
-    uint32_t *header = HEADER_PTR(ptr);
-    uint32_t *footer = FOOTER_PTR(ptr);
-    if (GET_SIZE(header) != GET_SIZE(footer) || GET_ALLOC(header) != GET_ALLOC(footer)) return;
 
-    // Update headers and coalesce
-    uint32_t size = GET_SIZE(HEADER_PTR(ptr));
-    PUT(HEADER_PTR(ptr), PACK(size, 0));
-    PUT(FOOTER_PTR(ptr), PACK(size, 0));
-    coalesce(ptr);
+    // Blocks always go back to the heap that owns them
+    heap_t *h = heap_of(ptr);
+#if MM_MMAP_THRESHOLD > 0
+    if (h == NULL)
+    {
+        if (GET_MMAPPED(HEADER_PTR(ptr))) huge_free(ptr);
+        return;
+    }
+#endif
+#if MM_SLAB
+    slab_t *slab = slab_of(h, ptr);
+    if (slab != NULL)
+    {
+#if MM_THREAD_SAFE
+        tcache_put(ptr, TCACHE_CLASSES + SLAB_CLASS(slab->obj_size));
+#else
+        LOCK(h);
+        slab_free(h, slab, ptr);
+        UNLOCK(h);
+#endif
+        return;
+    }
+#endif
+    free_tagged(h, ptr);
+}
+
+/*
+ * mm_free_sized - Free a block the caller knows was last requested with size bytes. Blocks
+ *     larger than the slab classes cannot be slab objects, so they skip the slab lookup.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+    if (ptr == NULL) return;
+#if MM_SLAB
+    if (size <= SLAB_MAX_SIZE)
+    {
+        mm_free(ptr);
+        return;
+    }
+#endif
+
+    heap_t *h = heap_of(ptr);
+#if MM_MMAP_THRESHOLD > 0
+    if (h == NULL)
+    {
+        huge_free(ptr);
+        return;
+    }
+#endif
+    free_tagged(h, ptr);
+}
+
+/*
+ * mm_usable_size - Number of bytes the caller may use at ptr, which can exceed the size it asked
+ *     for.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL) return 0;
+
+    heap_t *h = heap_of(ptr);
+#if MM_MMAP_THRESHOLD > 0
+    if (h == NULL) return HUGE_LENGTH(ptr) - HUGE_LEAD(ptr) - HUGE_OFFSET;
+#endif
+#if MM_SLAB
+    slab_t *slab = slab_of(h, ptr);
+    if (slab != NULL) return slab->obj_size;
+#endif
+    (void)h;
+    return GET_SIZE(HEADER_PTR(ptr)) - WSIZE;
 }
 
 /*
- * mm_realloc - Reallocates an allocated chunk with a different size.
+ * mm_realloc - Reallocates an allocated chunk with a different size. A NULL ptr allocates and a
+ *     size of 0 frees, returning NULL.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
-    uint32_t copy_size = GET_SIZE(HEADER_PTR(ptr));
-    uint32_t aligned_size = MAX(DSIZE + ALIGN(size), MIN_BLOCK_SIZE);
+    if (ptr == NULL) return mm_malloc(size);
+    if (size == 0)
+    {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    heap_t *h = heap_of(ptr);
+#if MM_MMAP_THRESHOLD > 0
+    if (h == NULL) return huge_realloc(ptr, size);
+#endif
+#if MM_SLAB
+    slab_t *slab = slab_of(h, ptr);
+    if (slab != NULL)
+    {
+        // Objects keep their slot while they fit, otherwise move to a fresh allocation
+        if (size <= slab->obj_size) return ptr;
+        LOCK(h);
+        void *new_ptr = heap_malloc(h, size);
+        if (new_ptr == NULL)
+        {
+            UNLOCK(h);
+            if ((new_ptr = malloc_fallback(h, 0, size)) == NULL) return NULL;
+            LOCK(h);
+        }
+        mm_copy(new_ptr, ptr, slab->obj_size);
+        slab_free(h, slab, ptr);
+        UNLOCK(h);
+        return new_ptr;
+    }
+#endif
+
+    if (size > MAX_REQUEST) return NULL;
+    word_t copy_size = GET_SIZE(HEADER_PTR(ptr));
+    word_t aligned_size = ADJUST_SIZE(size);
+
+    LOCK(h);
     if (aligned_size <= copy_size)
     {
-        // Reuse block
-        place(ptr, aligned_size);
+#if MM_REALLOC_HEADROOM
+        // Growing into slack from an earlier realloc keeps the rest of the slack
+        headroom_t *grown = headroom_find(h, ptr, copy_size);
+        if (grown != NULL && aligned_size > grown->asize)
+        {
+            grown->asize = aligned_size;
+            ++h->headroom_hits;
+            UNLOCK(h);
+            return ptr;
+        }
+        if (grown != NULL) grown->bp = NULL;
+#endif
+        // Reuse block, giving back the tail if it can stand on its own
+        if (copy_size - aligned_size >= MIN_BLOCK_SIZE)
+        {
+            PUT(HEADER_PTR(ptr), PACK(aligned_size, GET_PREV_ALLOC(HEADER_PTR(ptr)) | ALLOC));
+            void *rest = NEXT_BLOCK_PTR(ptr);
+            PUT(HEADER_PTR(rest), PACK(copy_size - aligned_size, PREV_ALLOC | ALLOC));
+            free_block(h, rest);
+        }
+        UNLOCK(h);
         return ptr;
     }
 
     // Check if we can use neighboring blocks
-    uint32_t coalesced_size = copy_size;
-    if (GET_ALLOC(HEADER_PTR(PREV_BLOCK_PTR(ptr))) == 0)
-        coalesced_size += GET_SIZE(HEADER_PTR(PREV_BLOCK_PTR(ptr)));
-    if (GET_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(ptr))) == 0)
-        coalesced_size += GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(ptr)));
+    void *prev = GET_PREV_ALLOC(HEADER_PTR(ptr)) ? NULL : PREV_BLOCK_PTR(ptr);
+    void *next = GET_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(ptr))) ? NULL : NEXT_BLOCK_PTR(ptr);
+    word_t grown_size = copy_size;
+    if (next != NULL) grown_size += GET_SIZE(HEADER_PTR(next));
 
-    if (aligned_size <= coalesced_size)
+    // A block at the end of the heap grows in place: extend by the shortfall, which merges with
+    // the free tail block if there is one
+    void *end = NEXT_BLOCK_PTR(next != NULL ? next : ptr);
+    if (aligned_size > grown_size && GET_SIZE(HEADER_PTR(end)) == 0)
     {
-        PUT(HEADER_PTR(ptr), PACK(copy_size, 0));
-        PUT(FOOTER_PTR(ptr), PACK(copy_size, 0));
-        void *coalesced = coalesce(ptr);
-        remove_free(coalesced);
-        if (coalesced == ptr)
+        word_t shortfall = MAX(aligned_size - grown_size, MIN_BLOCK_SIZE);
+        void *grown = extend_heap(h, shortfall / WSIZE);
+        if (grown != NULL)
         {
-            place(ptr, aligned_size);
-            return ptr;
+            next = grown;
+            grown_size = copy_size + GET_SIZE(HEADER_PTR(grown));
         }
-        memcpy(coalesced, ptr, copy_size - DSIZE);
-        place(coalesced, aligned_size);
-        return coalesced;
     }
 
-    // Allocate new block and copy contents
-    void *new_ptr = mm_malloc(size);
-    if (new_ptr == NULL) return NULL;
+    // Moving down into the previous block costs a copy, so only do it when growing forward fails
+    if (aligned_size <= grown_size) prev = NULL;
+    word_t coalesced_size = grown_size;
+    if (prev != NULL) coalesced_size += GET_SIZE(HEADER_PTR(prev));
 
-    memcpy(new_ptr, ptr, copy_size - DSIZE);
+    if (aligned_size <= coalesced_size)
+    {
+        // Absorb the free neighbors directly so their list links never land on live data
+        void *bp = ptr;
+        if (next != NULL) remove_free(h, next);
+        if (prev != NULL)
+        {
+            remove_free(h, prev);
+            bp = prev;
+        }
+        PUT(HEADER_PTR(bp), PACK(coalesced_size, GET_PREV_ALLOC(HEADER_PTR(bp)) | ALLOC));
+        if (bp != ptr) mm_copy(bp, ptr, copy_size - WSIZE);
+#if MM_REALLOC_HEADROOM
+        // Keep slack out of the absorbed space rather than splitting it off
+        place(h, bp, MIN(ADJUST_SIZE(headroom_request(h, size)), coalesced_size));
+        headroom_grant(h, bp, aligned_size);
+#else
+        place(h, bp, aligned_size);
+#endif
+        UNLOCK(h);
+        return bp;
+    }
 
-    mm_free(ptr);
+    // Allocate new block from the owning heap (or a mapping of its own) and copy contents
+    size_t request = size;
+#if MM_REALLOC_HEADROOM
+    request = headroom_request(h, size);
+#endif
+#if MM_MMAP_THRESHOLD > 0
+    void *new_ptr = size >= MM_MMAP_THRESHOLD ? huge_alloc(size, 0) : heap_malloc(h, request);
+#else
+    void *new_ptr = heap_malloc(h, request);
+#endif
+    if (new_ptr == NULL)
+    {
+        // ptr stays allocated, so nothing else touches it while the lock is dropped
+        UNLOCK(h);
+        if ((new_ptr = malloc_fallback(h, 0, size)) == NULL) return NULL;
+        LOCK(h);
+    }
+#if MM_REALLOC_HEADROOM
+    else if (request != size && heap_of(new_ptr) == h)
+        headroom_grant(h, new_ptr, aligned_size);
+#endif
+    mm_copy(new_ptr, ptr, copy_size - WSIZE);
+    free_block(h, ptr);
+    UNLOCK(h);
     return new_ptr;
 }
 
 /*
- * Static Helper Functions
+ * mm_malloc_batch - Allocate n blocks of size bytes into out, carving them from one free block
+ *     when the heap has one large enough. Returns how many blocks were allocated.
  */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    if (size == 0 || n == 0) return 0;
+
+    size_t count = 0;
+#if MM_MMAP_THRESHOLD > 0
+    if (size >= MM_MMAP_THRESHOLD)
+    {
+        while (count < n && (out[count] = huge_alloc(size, 0)) != NULL) ++count;
+        return count;
+    }
+#endif
+
+    heap_t *h = heap_for_thread();
+    if (h != NULL)
+    {
+        LOCK(h);
+#if MM_THREAD_SAFE
+        remote_drain(h);
+#endif
+        if (!(MM_SLAB && size <= SLAB_MAX_SIZE) && size <= MAX_REQUEST)
+            count = malloc_run(h, ADJUST_SIZE(size), n, out);
+
+        // Whatever did not fit in one run is allocated one block at a time
+        while (count < n && (out[count] = heap_malloc(h, size)) != NULL) ++count;
+        UNLOCK(h);
+    }
+    while (count < n && (out[count] = malloc_fallback(h, 0, size)) != NULL) ++count;
+    return count;
+}
 
-static void *extend_heap(uint32_t words)
+/*
+ * mm_free_batch - Free n blocks at once. ptrs is sorted by address in place, so blocks of the
+ *     batch that sit next to each other are merged before a single coalesce.
+ */
+void mm_free_batch(void **ptrs, size_t n)
 {
-    uint32_t size = (words % 2 == 0) ? words * WSIZE : (words + 1) * WSIZE;
-    char *bp = mem_sbrk(size);
-    if (bp == (void *)-1) return NULL;
+    sort_ptrs(ptrs, n);
 
-    PUT(HEADER_PTR(bp), PACK(size, 0));               // set header
-    PUT(FOOTER_PTR(bp), PACK(size, 0));               // set footer
-    PUT(HEADER_PTR(NEXT_BLOCK_PTR(bp)), PACK(0, 1));  // set epilogue
+    heap_t *locked = NULL;
+    for (size_t i = 0; i < n; ++i)
+    {
+        char *bp = ptrs[i];
+        if (bp == NULL) continue;
+        heap_t *h = heap_of(bp);
+#if MM_MMAP_THRESHOLD > 0
+        if (h == NULL)
+        {
+            huge_free(bp);
+            continue;
+        }
+#endif
+        if (h != locked)
+        {
+            // Runs of blocks from the same heap share one lock acquisition
+            if (locked != NULL) UNLOCK(locked);
+            LOCK(h);
+            locked = h;
+        }
+#if MM_SLAB
+        slab_t *slab = slab_of(h, bp);
+        if (slab != NULL)
+        {
+            slab_free(h, slab, bp);
+            continue;
+        }
+#endif
+        if (GET_ALLOC(HEADER_PTR(bp)) == 0) continue;
 
-    return coalesce(bp);
+        // Fold the blocks of the batch that directly follow this one into it
+        word_t size = GET_SIZE(HEADER_PTR(bp));
+        while (i + 1 < n && ptrs[i + 1] == bp + size)
+        {
+            size += GET_SIZE(HEADER_PTR(ptrs[i + 1]));
+            ++i;
+        }
+        PUT(HEADER_PTR(bp), PACK(size, GET_PREV_ALLOC(HEADER_PTR(bp)) | ALLOC));
+        free_block(h, bp);
+    }
+    if (locked != NULL) UNLOCK(locked);
 }
 
-static void *coalesce(void *bp)
+/*
+ * mm_calloc - Allocate zeroed memory for nmemb objects of size bytes. Blocks carved from heap
+ *     memory that has never been handed out are already zero and are not cleared again.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
 {
-    uint32_t prev_allocated = GET_ALLOC(FOOTER_PTR(PREV_BLOCK_PTR(bp)));
-    uint32_t next_allocated = GET_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
-    uint32_t size = GET_SIZE(HEADER_PTR(bp));
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes) || bytes == 0) return NULL;
 
-    if (prev_allocated == 1 && next_allocated == 0)
+#if MM_MMAP_THRESHOLD > 0
+    if (bytes >= MM_MMAP_THRESHOLD) return huge_alloc(bytes, 0);  // fresh mappings are zero
+#endif
+#if MM_THREAD_SAFE
+    void *cached = tcache_get(bytes);
+    if (cached != NULL)
     {
-        // Coalesce with next block
-        remove_free(NEXT_BLOCK_PTR(bp));
-        size += GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
-        PUT(HEADER_PTR(bp), PACK(size, 0));
-        PUT(FOOTER_PTR(bp), PACK(size, 0));
+        mm_zero(cached, bytes);
+        return cached;
     }
-    else if (prev_allocated == 0 && next_allocated == 1)
+#endif
+
+    heap_t *h = heap_for_thread();
+    char *bp = NULL;
+    char *clean_lo = NULL;
+    if (h != NULL)
     {
-        // Coalesce with previous block
-        remove_free(PREV_BLOCK_PTR(bp));
-        size += GET_SIZE(HEADER_PTR(PREV_BLOCK_PTR(bp)));
-        PUT(HEADER_PTR(PREV_BLOCK_PTR(bp)), PACK(size, 0));
-        PUT(FOOTER_PTR(bp), PACK(size, 0));
-        bp = PREV_BLOCK_PTR(bp);
+        LOCK(h);
+        clean_lo = h->clean_lo;
+        bp = heap_malloc(h, bytes);
+        UNLOCK(h);
     }
-    else if (prev_allocated == 0 && next_allocated == 0)
+    if (bp == NULL)
     {
-        // Coalesce with both neighbor blocks
-        remove_free(PREV_BLOCK_PTR(bp));
-        remove_free(NEXT_BLOCK_PTR(bp));
-        size += GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(bp))) + GET_SIZE(HEADER_PTR(PREV_BLOCK_PTR(bp)));
-        PUT(HEADER_PTR(PREV_BLOCK_PTR(bp)), PACK(size, 0));
-        PUT(FOOTER_PTR(NEXT_BLOCK_PTR(bp)), PACK(size, 0));
-        bp = PREV_BLOCK_PTR(bp);
+        // Another heap's watermark is not known here, so the whole block is cleared
+        if ((bp = malloc_fallback(h, 0, bytes)) != NULL) mm_zero(bp, bytes);
+        return bp;
+    }
+
+#if MM_SLAB
+    if (bytes <= SLAB_MAX_SIZE)
+    {
+        mm_zero(bp, bytes);
+        return bp;
     }
-    insert_free(bp);
+#endif
+    // Only the part below the old watermark and the old footer word can hold stale data
+    size_t dirty = bp < clean_lo ? MIN(bytes, (size_t)(clean_lo - bp)) : 0;
+    mm_zero(bp, dirty);
+    char *footer = (char *)FOOTER_PTR(bp);
+    if (footer >= bp + dirty && footer < bp + bytes) PUT(footer, 0);
     return bp;
 }
 
-static void *first_fit(uint32_t size)
+/*
+ * mm_memalign - Allocate a block whose address is a multiple of alignment, a power of two.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0) return NULL;
+    if (alignment <= ALIGNMENT) return mm_malloc(size);
+#if MM_MMAP_THRESHOLD > 0
+    if (size >= MM_MMAP_THRESHOLD) return huge_alloc(size, alignment);
+#endif
+    if (size > MAX_REQUEST / 2 || alignment > MAX_REQUEST / 2) return NULL;
+
+    heap_t *h = heap_for_thread();
+    if (h == NULL) return malloc_fallback(NULL, alignment, size);
+    LOCK(h);
+#if MM_THREAD_SAFE
+    remote_drain(h);
+#endif
+    void *bp = malloc_aligned(h, alignment, ADJUST_SIZE(size));
+    UNLOCK(h);
+    return bp != NULL ? bp : malloc_fallback(h, alignment, size);
+}
+
+/*
+ * mm_aligned_alloc - C11 aligned_alloc.
+ */
+void *mm_aligned_alloc(size_t alignment, size_t size) { return mm_memalign(alignment, size); }
+
+/*
+ * mm_posix_memalign - POSIX posix_memalign: alignment must be a power of two multiple of
+ *     sizeof(void *). Returns 0, EINVAL or ENOMEM and leaves *memptr alone on failure.
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-    for (int i = get_list_index(size); i < NUM_LISTS; ++i)
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if (size == 0)
     {
-        void *bp = segregated_lists[i];
-        while (bp != NULL)
-        {
-            if (GET_SIZE(HEADER_PTR(bp)) >= size) return bp;
-            bp = next_free(bp);
-        }
+        *memptr = NULL;
+        return 0;
     }
-    return NULL;
+    void *bp = mm_memalign(alignment, size);
+    if (bp == NULL) return ENOMEM;
+    *memptr = bp;
+    return 0;
 }
 
-static void place(void *bp, uint32_t size)
+/*
+ * mm_trim - Give free memory back to the system, keeping at most pad free bytes at the end of
+ *     each heap. Returns 1 if any memory was released.
+ */
+int mm_trim(size_t pad)
 {
-    uint32_t block_size = GET_SIZE(HEADER_PTR(bp));
+    int released = 0;
+#if MM_THREAD_SAFE
+    // Blocks sitting in this thread's cache cannot be released
+    tcache_t *cache = tcache_acquire();
+    for (int i = 0; i < TCACHE_SLOTS; ++i) tcache_flush(cache, i, 0);
+#endif
 
-    if (block_size - size >= MIN_BLOCK_SIZE)
-    {
-        // Split block
-        PUT(HEADER_PTR(bp), PACK(size, 1));
-        PUT(FOOTER_PTR(bp), PACK(size, 1));
-
-        PUT(HEADER_PTR(NEXT_BLOCK_PTR(bp)), PACK(block_size - size, 0));
-        PUT(FOOTER_PTR(NEXT_BLOCK_PTR(bp)), PACK(block_size - size, 0));
-        insert_free(NEXT_BLOCK_PTR(bp));
-    }
-    else
+    for (int i = 0; i < NUM_HEAPS; ++i)
     {
-        // Don't split block
-        PUT(HEADER_PTR(bp), PACK(block_size, 1));
-        PUT(FOOTER_PTR(bp), PACK(block_size, 1));
+        heap_t *h = &heaps[i];
+        LOCK(h);
+        if (h->ready)
+        {
+#if MM_THREAD_SAFE
+            remote_drain(h);
+#endif
+            released |= heap_trim(h, pad);
+            for (void *bp = h->heap_list_ptr; GET_SIZE(HEADER_PTR(bp)) != 0; bp = NEXT_BLOCK_PTR(bp))
+            {
+                if (GET_ALLOC(HEADER_PTR(bp)) == 0 && release_block(bp) > 0) released = 1;
+            }
+        }
+        UNLOCK(h);
     }
+    return released;
 }
 
 /*
- * Free List Functionality
+ * Static Helper Functions
  */
 
-static int get_list_index(uint32_t size)
+static int heap_init(heap_t *h)
 {
-    if (size == 24) return 0;
-    if (size == 32) return 1;
-    if (size == 40) return 2;
-    if (size == 48) return 3;
-    if (size == 56) return 4;
-    if (size == 64) return 5;
-    if (size <= 128) return 6;
-    if (size <= 256) return 7;
-    if (size <= 512) return 8;
-    if (size <= 1024) return 9;
-    if (size <= 2048) return 10;
-    if (size <= 4096) return 11;
-    if (size <= 8192) return 12;
-    if (size <= 16384) return 13;
-    return 14;
-}
+#if MM_THREAD_SAFE
+    h->remote_free = NULL;
+#endif
+    // heap_of reads the range of every heap without its lock
+    __atomic_store_n(&h->lo, (char *)mem_heap_base(h->mem), __ATOMIC_RELAXED);
+    __atomic_store_n(&h->hi, (char *)mem_heap_limit(h->mem), __ATOMIC_RELAXED);
+    h->clean_lo = mem_heap_clean(h->mem);
+#if MM_REALLOC_HEADROOM
+    memset(h->grown, 0, sizeof(h->grown));
+    h->grown_next = 0;
+    h->headroom_shift = HEADROOM_START_SHIFT;
+    h->headroom_grants = h->headroom_hits = 0;
+#endif
 
-static void insert_free(void *bp)
-{
-    int idx = get_list_index(GET_SIZE(HEADER_PTR(bp)));
-    void *free_list_ptr = segregated_lists[idx];
+    // Initialize free lists
+#if MM_ENGINE == MM_ENGINE_TLSF
+    memset(h->tlsf_lists, 0, sizeof(h->tlsf_lists));
+    memset(h->sl_bitmap, 0, sizeof(h->sl_bitmap));
+    h->fl_bitmap = 0;
+#else
+    for (int i = 0; i < NUM_LISTS; ++i)
+    {
+        h->segregated_lists[i] = NULL;
+    }
+    h->nonempty_lists = 0;
+#endif
+#if MM_SLAB
+    memset(h->partial_slabs, 0, sizeof(h->partial_slabs));
+    memset(h->slab_pages, 0, sizeof(h->slab_pages));
+#endif
 
-    // Set prev and next for current block
-    PUT_PTR(NEXT_FREE_PTR(bp), free_list_ptr);
-    PUT_PTR(PREV_FREE_PTR(bp), NULL);
+    // Initialize start of heap
+    char *start = mem_heap_sbrk(h->mem, 4 * WSIZE);
+    if (start == (void *)-1) return -1;
+    PUT(start, 0);                                          // 4 byte padding word
+    PUT(start + WSIZE, PACK(DSIZE, PREV_ALLOC | ALLOC));    // prologue header
+    PUT(start + (2 * WSIZE), PACK(DSIZE, ALLOC));           // prologue footer
+    PUT(start + (3 * WSIZE), PACK(0, PREV_ALLOC | ALLOC));  // epilogue
+    h->heap_list_ptr = start + (2 * WSIZE);
 
-    // Connect the rest of the list and update head
-    if (free_list_ptr != NULL) PUT_PTR(PREV_FREE_PTR(free_list_ptr), bp);
+    // Add first free block
+    if (extend_heap(h, CHUNK_SIZE / WSIZE) == NULL) return -1;
+    // Threads that see the heap ready without its lock see its range and prologue too
+    __atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+    return 0;
+}
 
-    segregated_lists[idx] = bp;
+static heap_t *heap_for_thread(void)
+{
+#if MM_THREAD_SAFE
+    heap_t *h = thread_heap;
+    if (h == NULL)
+    {
+        // Hand out heaps round-robin; the first thread gets the default heap
+        uint32_t idx = __atomic_fetch_add(&next_heap, 1, __ATOMIC_RELAXED) % NUM_HEAPS;
+        h = thread_heap = &heaps[idx];
+    }
+    return heap_prepare(h) < 0 ? NULL : h;
+#else
+    return &heaps[0];
+#endif
 }
 
-static void remove_free(void *bp)
+#if MM_THREAD_SAFE
+// Secondary heaps get their memlib region and prologue on first use
+static int heap_prepare(heap_t *h)
 {
-    int idx = get_list_index(GET_SIZE(HEADER_PTR(bp)));
+    if (__atomic_load_n(&h->ready, __ATOMIC_ACQUIRE)) return 0;
+    LOCK(h);
+    if (!h->ready && h->mem == NULL) h->mem = mem_heap_create(MAX_HEAP);
+    int status = (h->ready || h->mem == NULL) ? 0 : heap_init(h);
+    UNLOCK(h);
+    return h->mem == NULL ? -1 : status;
+}
+#endif
 
-    void *prev = prev_free(bp);
-    void *next = next_free(bp);
+// Allocates size bytes (aligned to alignment if that is past ALIGNMENT) somewhere other than the
+// full heap, which is the thread's own and is not locked: first any other heap with room, then a
+// mapping of its own
+static void *malloc_fallback(heap_t *full, size_t alignment, size_t size)
+{
+#if MM_THREAD_SAFE
+    for (int i = 0; i < NUM_HEAPS; ++i)
+    {
+        heap_t *h = &heaps[i];
+        if (h == full || heap_prepare(h) < 0) continue;
+        LOCK(h);
+        void *bp = alignment > ALIGNMENT ? malloc_aligned(h, alignment, ADJUST_SIZE(size))
+                                         : heap_malloc(h, size);
+        UNLOCK(h);
+        if (bp != NULL) return bp;
+    }
+#else
+    (void)full;
+#endif
+#if MM_MMAP_THRESHOLD > 0
+    return huge_alloc(size, alignment);
+#else
+    (void)alignment;
+    (void)size;
+    return NULL;
+#endif
+}
 
-    if (prev != NULL && next != NULL)
+// Returns the heap whose region contains bp, or NULL for mapped blocks
+static heap_t *heap_of(void *bp)
+{
+#if MM_THREAD_SAFE
+    for (int i = 0; i < NUM_HEAPS; ++i)
     {
-        PUT_PTR(NEXT_FREE_PTR(prev), next);
-        PUT_PTR(PREV_FREE_PTR(next), prev);
+        // Other threads may be setting up heaps this one does not own
+        char *lo = __atomic_load_n(&heaps[i].lo, __ATOMIC_RELAXED);
+        char *hi = __atomic_load_n(&heaps[i].hi, __ATOMIC_RELAXED);
+        if ((char *)bp >= lo && (char *)bp < hi) return &heaps[i];
     }
-    else if (prev == NULL && next != NULL)
+    assert(MM_MMAP_THRESHOLD > 0 && "pointer not owned by any heap");
+    return NULL;
+#elif MM_MMAP_THRESHOLD > 0
+    if ((char *)bp < heaps[0].lo || (char *)bp >= heaps[0].hi) return NULL;
+    return &heaps[0];
+#else
+    (void)bp;
+    return &heaps[0];
+#endif
+}
+
+static void *heap_malloc(heap_t *h, size_t size)
+{
+#if MM_THREAD_SAFE
+    remote_drain(h);
+#endif
+#if MM_SLAB
+    if (size <= SLAB_MAX_SIZE) return slab_alloc(h, size);
+#endif
+    if (size > MAX_REQUEST) return NULL;
+    return malloc_block(h, ADJUST_SIZE(size));
+}
+
+#if MM_THREAD_SAFE
+static void heap_free(heap_t *h, void *bp)
+{
+#if MM_SLAB
+    slab_t *slab = slab_of(h, bp);
+    if (slab != NULL)
     {
-        PUT_PTR(PREV_FREE_PTR(next), NULL);
-        segregated_lists[idx] = next;
+        slab_free(h, slab, bp);
+        return;
     }
-    else if (prev != NULL && next == NULL)
+#endif
+    free_block(h, bp);
+}
+#endif
+
+// Frees a block with boundary tags through the thread cache or its heap
+static void free_tagged(heap_t *h, void *bp)
+{
+    // Make sure pointer is valid
+    word_t *header = HEADER_PTR(bp);
+    if (GET_ALLOC(header) == 0) return;
+
+#if MM_THREAD_SAFE
+    int idx = get_list_index(GET_SIZE(header));
+    if (idx < TCACHE_CLASSES)
     {
-        PUT_PTR(NEXT_FREE_PTR(prev), NULL);
+        tcache_put(bp, idx);
+        return;
     }
-    else
+    if (h != thread_heap)
     {
-        segregated_lists[idx] = NULL;
+        remote_push(h, bp, bp);
+        return;
     }
+#endif
 
-    PUT_PTR(PREV_FREE_PTR(bp), NULL);
-    PUT_PTR(NEXT_FREE_PTR(bp), NULL);
+    LOCK(h);
+#if MM_THREAD_SAFE
+    remote_drain(h);
+#endif
+    free_block(h, bp);
+    UNLOCK(h);
 }
 
-static void *next_free(void *bp)
+static void *malloc_block(heap_t *h, word_t size)
 {
-    if (bp == NULL) return NULL;
-    return GET_PTR(NEXT_FREE_PTR(bp));
+    void *bp = find_fit(h, size);
+
+    if (bp != NULL)
+    {
+        remove_free(h, bp);
+        place(h, bp, size);
+        return bp;
+    }
+
+    // No space found, extend heap
+    if ((bp = extend_to(h, size)) == NULL) return NULL;
+    remove_free(h, bp);
+    place(h, bp, size);
+    return bp;
 }
 
-static void *prev_free(void *bp)
+// Carves up to n blocks of size bytes out of one free block and returns how many it placed
+static size_t malloc_run(heap_t *h, word_t size, size_t n, void **out)
 {
-    if (bp == NULL) return NULL;
-    return GET_PTR(PREV_FREE_PTR(bp));
+    n = MIN(n, MAX_REQUEST / size);
+    word_t total = size * n;
+    void *bp = find_fit(h, total);
+    if (bp == NULL && (bp = extend_to(h, total)) == NULL) return 0;
+    remove_free(h, bp);
+
+    // Every block but the last gets a plain header; place splits the remainder off the last one
+    word_t block_size = GET_SIZE(HEADER_PTR(bp));
+    word_t prev_alloc = GET_PREV_ALLOC(HEADER_PTR(bp));
+    char *p = bp;
+    for (size_t i = 0; i + 1 < n; ++i, p += size)
+    {
+        PUT(HEADER_PTR(p), PACK(size, prev_alloc | ALLOC));
+        prev_alloc = PREV_ALLOC;
+        out[i] = p;
+    }
+    PUT(HEADER_PTR(p), PACK(block_size - (n - 1) * size, prev_alloc | ALLOC));
+    place(h, p, size);
+    out[n - 1] = p;
+    return n;
 }
 
-/*
- * Printers
- */
+// Like malloc_block, but the payload lands on a multiple of alignment, a power of two
+static void *malloc_aligned(heap_t *h, size_t alignment, word_t size)
+{
+    // A free block this large fits the block after a gap that is either empty or a free block
+    word_t search = size + alignment + MIN_BLOCK_SIZE;
+    void *bp = find_fit(h, search);
+    if (bp == NULL && (bp = extend_to(h, search)) == NULL) return NULL;
+    remove_free(h, bp);
+
+    char *p = (char *)(((uintptr_t)bp + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    while (p != bp && (word_t)(p - (char *)bp) < MIN_BLOCK_SIZE) p += alignment;
+    return place_at(h, bp, p, size);
+}
 
-static void print_heap_list()
+static void free_block(heap_t *h, void *bp)
 {
-    printf("HEAP LIST:\n");
-    void *bp = heap_list_ptr;
-    while (GET_SIZE(HEADER_PTR(bp)) != 0)
+    word_t size = GET_SIZE(HEADER_PTR(bp));
+    PUT(HEADER_PTR(bp), PACK(size, GET_PREV_ALLOC(HEADER_PTR(bp))));
+    PUT(FOOTER_PTR(bp), PACK(size, 0));
+    CLEAR_PREV_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
+    void *merged = coalesce(h, bp);
+
+    // Hand memory back to the system: shrink the heap once its free tail grows large, and give up
+    // the pages of a large block freed in the middle (its neighbors were handled when freed)
+    word_t merged_size = GET_SIZE(HEADER_PTR(merged));
+    if (GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(merged))) == 0)
     {
-        uint32_t size = GET_SIZE(HEADER_PTR(bp));
-        uint32_t allocated = GET_ALLOC(HEADER_PTR(bp));
-        printf("%d, %d\n", allocated, size);
-        bp = NEXT_BLOCK_PTR(bp);
+        if (MM_TRIM_THRESHOLD > 0 && merged_size >= MM_TRIM_THRESHOLD) heap_trim(h, MM_TRIM_PAD);
+    }
+    else if (MM_RELEASE_THRESHOLD > 0 && size >= MM_RELEASE_THRESHOLD)
+    {
+        char *lo = MAX((char *)bp, (char *)merged + 2 * sizeof(void *));
+        char *hi = MIN((char *)bp + size, (char *)FOOTER_PTR(merged));
+        mem_release(lo, hi - lo);
     }
-    printf("\n");
 }
 
-static void print_free_list(void *free_list_ptr)
+static void *extend_heap(heap_t *h, size_t words)
 {
-    printf("FREE LIST: ");
-    void *bp = free_list_ptr;
-    while (bp != NULL)
+    size_t size = ALIGN(words * WSIZE);
+    if (size > INTPTR_MAX) return NULL;
+    char *bp = mem_heap_sbrk(h->mem, size);
+    if (bp == (void *)-1) return NULL;
+
+    // The old epilogue becomes the header and keeps its prev-alloc bit
+    PUT(HEADER_PTR(bp), PACK(size, GET_PREV_ALLOC(HEADER_PTR(bp))));  // set header
+    PUT(FOOTER_PTR(bp), PACK(size, 0));                               // set footer
+    PUT(HEADER_PTR(NEXT_BLOCK_PTR(bp)), PACK(0, ALLOC));              // set epilogue
+
+    // Merging with a free tail buries its footer and the old epilogue inside the block
+    void *merged = coalesce(h, bp);
+    if (merged != bp)
     {
-        uint32_t size = GET_SIZE(HEADER_PTR(bp));
-        printf("(size: %d, addr: %p, prev: %p, next: %p) ", size, bp, GET_PTR(PREV_FREE_PTR(bp)),
-               GET_PTR(NEXT_FREE_PTR(bp)));
-        bp = next_free(bp);
+        scrub_tag(h, HEADER_PTR(bp));
+        scrub_tag(h, HEADER_PTR(bp) - 1);
     }
-    printf("\n");
+    return merged;
 }
 
-static void print_segregated_lists()
+// Returns a free block of at least size bytes at the end of the heap, growing the heap by exactly
+// what the free block already there (if any) lacks
+static void *extend_to(heap_t *h, word_t size)
 {
-    printf("--- SEGREGATED LIST ---\n");
-    for (int i = 0; i < NUM_LISTS; ++i)
+    char *brk = mem_heap_sbrk(h->mem, 0);
+    word_t tail_size = 0;
+    if (!GET_PREV_ALLOC(HEADER_PTR(brk)))
     {
-        print_free_list(segregated_lists[i]);
+        void *tail = PREV_BLOCK_PTR(brk);
+        tail_size = GET_SIZE(HEADER_PTR(tail));
+        if (tail_size >= size) return tail;
     }
-    printf(" ---------------------- \n");
-}
\ No newline at end of file
+    return extend_heap(h, MAX(MIN_BLOCK_SIZE, size - tail_size) / WSIZE);
+}
+
+static void *coalesce(heap_t *h, void *bp)
+{
+    uint32_t prev_allocated = GET_PREV_ALLOC(HEADER_PTR(bp)) != 0;
+    uint32_t next_allocated = GET_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
+    word_t size = GET_SIZE(HEADER_PTR(bp));
+
+    // Free blocks never sit next to each other, so a merged block always follows an allocated one
+    if (prev_allocated == 1 && next_allocated == 0)
+    {
+        // Coalesce with next block
+        remove_free(h, NEXT_BLOCK_PTR(bp));
+        size += GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
+        PUT(HEADER_PTR(bp), PACK(size, PREV_ALLOC));
+        PUT(FOOTER_PTR(bp), PACK(size, 0));
+    }
+    else if (prev_allocated == 0 && next_allocated == 1)
+    {
+        // Coalesce with previous block
+        remove_free(h, PREV_BLOCK_PTR(bp));
+        size += GET_SIZE(HEADER_PTR(PREV_BLOCK_PTR(bp)));
+        PUT(HEADER_PTR(PREV_BLOCK_PTR(bp)), PACK(size, PREV_ALLOC));
+        PUT(FOOTER_PTR(bp), PACK(size, 0));
+        bp = PREV_BLOCK_PTR(bp);
+    }
+    else if (prev_allocated == 0 && next_allocated == 0)
+    {
+        // Coalesce with both neighbor blocks
+        remove_free(h, PREV_BLOCK_PTR(bp));
+        remove_free(h, NEXT_BLOCK_PTR(bp));
+        size += GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(bp))) + GET_SIZE(HEADER_PTR(PREV_BLOCK_PTR(bp)));
+        PUT(HEADER_PTR(PREV_BLOCK_PTR(bp)), PACK(size, PREV_ALLOC));
+        PUT(FOOTER_PTR(NEXT_BLOCK_PTR(bp)), PACK(size, 0));
+        bp = PREV_BLOCK_PTR(bp);
+    }
+    insert_free(h, bp);
+    return bp;
+}
+
+static void place(heap_t *h, void *bp, word_t size)
+{
+    word_t block_size = GET_SIZE(HEADER_PTR(bp));
+    word_t prev_alloc = GET_PREV_ALLOC(HEADER_PTR(bp));
+
+    if (block_size - size >= MIN_BLOCK_SIZE)
+    {
+        // Split block
+        PUT(HEADER_PTR(bp), PACK(size, prev_alloc | ALLOC));
+
+        void *rest = NEXT_BLOCK_PTR(bp);
+        PUT(HEADER_PTR(rest), PACK(block_size - size, PREV_ALLOC));
+        PUT(FOOTER_PTR(rest), PACK(block_size - size, 0));
+        CLEAR_PREV_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(rest)));
+        insert_free(h, rest);
+    }
+    else
+    {
+        // Don't split block
+        PUT(HEADER_PTR(bp), PACK(block_size, prev_alloc | ALLOC));
+        SET_PREV_ALLOC(HEADER_PTR(NEXT_BLOCK_PTR(bp)));
+    }
+
+    // Everything handed out is dirty from now on, including slack the block keeps unsplit
+    char *end = (char *)bp + GET_SIZE(HEADER_PTR(bp));
+    if (end > h->clean_lo) h->clean_lo = end;
+}
+
+// Allocates size bytes with the payload at p inside the free block bp, which is already off the
+// free lists; the part of bp in front of p must be zero or at least MIN_BLOCK_SIZE bytes
+static void *place_at(heap_t *h, void *bp, char *p, word_t size)
+{
+    word_t block_size = GET_SIZE(HEADER_PTR(bp));
+    word_t front = p - (char *)bp;
+    if (front > 0)
+    {
+        // Return the leading gap to the free lists as its own block
+        PUT(HEADER_PTR(bp), PACK(front, GET_PREV_ALLOC(HEADER_PTR(bp))));
+        PUT(FOOTER_PTR(bp), PACK(front, 0));
+        insert_free(h, bp);
+        PUT(HEADER_PTR(p), PACK(block_size - front, 0));
+    }
+    place(h, p, size);
+    return p;
+}
+
+// Shrinks the heap so that at most pad bytes of free space stay at its end, in whole pages
+static int heap_trim(heap_t *h, size_t pad)
+{
+    // The epilogue header is the last word below brk
+    char *brk = mem_heap_sbrk(h->mem, 0);
+    if (GET_PREV_ALLOC(HEADER_PTR(brk))) return 0;
+    void *last = PREV_BLOCK_PTR(brk);
+    word_t size = GET_SIZE(HEADER_PTR(last));
+
+    size_t keep = ALIGN(pad);
+    if (keep != 0 && keep < MIN_BLOCK_SIZE) keep = MIN_BLOCK_SIZE;
+    if (keep >= size) return 0;
+    word_t page = mem_pagesize();
+    word_t release = (size - keep) & ~(page - 1);
+    if (size - release != 0 && size - release < MIN_BLOCK_SIZE) release -= page;
+    if (release == 0) return 0;
+
+    // The old footer and epilogue end up past brk, where they could reappear in a fresh block
+    scrub_tag(h, FOOTER_PTR(last));
+    scrub_tag(h, HEADER_PTR(brk));
+    remove_free(h, last);
+    if (release == size)
+    {
+        // The whole block goes, so the epilogue follows an allocated block again
+        PUT(HEADER_PTR(last), PACK(0, PREV_ALLOC | ALLOC));
+    }
+    else
+    {
+        PUT(HEADER_PTR(last), PACK(size - release, PREV_ALLOC));
+        PUT(FOOTER_PTR(last), PACK(size - release, 0));
+        insert_free(h, last);
+        PUT(HEADER_PTR(NEXT_BLOCK_PTR(last)), PACK(0, ALLOC));
+    }
+    mem_heap_sbrk(h->mem, -(intptr_t)release);
+    return 1;
+}
+
+// Releases the pages inside free block bp, keeping its header, links and footer in place
+static size_t release_block(void *bp)
+{
+    char *lo = (char *)bp + 2 * sizeof(void *);
+    return mem_release(lo, (char *)FOOTER_PTR(bp) - lo);
+}
+
+// Clears a stale boundary tag in the clean part of the heap, which must read as zero
+static void scrub_tag(heap_t *h, word_t *p)
+{
+    if ((char *)p >= h->clean_lo) PUT(p, 0);
+}
+
+// Sorts n pointers by address in place; heapsort needs neither recursion nor memory
+static void sort_ptrs(void **a, size_t n)
+{
+    // Batches handed out by mm_malloc_batch usually come back already in order
+    size_t sorted = 1;
+    while (sorted < n && (uintptr_t)a[sorted - 1] <= (uintptr_t)a[sorted]) ++sorted;
+    if (sorted >= n) return;
+
+    for (size_t i = n / 2; i-- > 0;) sift_down(a, i, n);
+    for (size_t end = n; end-- > 1;)
+    {
+        void *top = a[0];
+        a[0] = a[end];
+        a[end] = top;
+        sift_down(a, 0, end);
+    }
+}
+
+static void sift_down(void **a, size_t i, size_t n)
+{
+    for (size_t child; (child = 2 * i + 1) < n; i = child)
+    {
+        if (child + 1 < n && (uintptr_t)a[child + 1] > (uintptr_t)a[child]) ++child;
+        if ((uintptr_t)a[i] >= (uintptr_t)a[child]) return;
+        void *tmp = a[i];
+        a[i] = a[child];
+        a[child] = tmp;
+    }
+}
+
+/*
+ * Realloc Headroom
+ *
+ * Each upward realloc that moves or absorbs neighbors asks for slack on top of the new size.
+ * A later growth that fits in the slack is a hit; the hit rate per window of grants tunes how
+ * much slack the next grants get.
+ */
+
+#if MM_REALLOC_HEADROOM
+// Returns the request size to use for a block growing to size bytes
+static size_t headroom_request(heap_t *h, size_t size)
+{
+    if (MM_SLAB && size <= SLAB_MAX_SIZE) return size;
+    size_t slack = ALIGN(size >> h->headroom_shift);
+    return size <= MAX_REQUEST - slack ? size + slack : size;
+}
+
+// Remembers bp, just grown to asize, if it got slack beyond that, and tunes the policy
+static void headroom_grant(heap_t *h, void *bp, word_t asize)
+{
+    word_t block = GET_SIZE(HEADER_PTR(bp));
+    if (block <= asize) return;
+    headroom_t *slot = &h->grown[h->grown_next++ % HEADROOM_SLOTS];
+    slot->bp = bp;
+    slot->block = block;
+    slot->asize = asize;
+
+    if (++h->headroom_grants < HEADROOM_WINDOW) return;
+    if (h->headroom_hits < HEADROOM_WINDOW / 2 && h->headroom_shift < HEADROOM_MAX_SHIFT)
+        ++h->headroom_shift;
+    else if (h->headroom_hits >= HEADROOM_WINDOW && h->headroom_shift > HEADROOM_MIN_SHIFT)
+        --h->headroom_shift;
+    h->headroom_grants = h->headroom_hits = 0;
+}
+
+// Returns the slot remembering bp, a block of the given size, if there is one
+static headroom_t *headroom_find(heap_t *h, void *bp, word_t block)
+{
+    for (int i = 0; i < HEADROOM_SLOTS; ++i)
+    {
+        if (h->grown[i].bp == bp && h->grown[i].block == block) return &h->grown[i];
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * Huge Allocations
+ *
+ * Requests of MM_MMAP_THRESHOLD bytes or more bypass the heaps, aligned ones included. Each gets a
+ * page-rounded mapping that starts with its length and the offset of that length word from the
+ * start of the mapping, followed by a header word carrying the MMAPPED bit, so freeing it unmaps
+ * it right away and growing it can let the kernel move the pages.
+ */
+
+#if MM_MMAP_THRESHOLD > 0
+// Maps a block for size bytes; an alignment past ALIGNMENT over-maps by that much and moves the
+// payload up to the first aligned address
+static void *huge_alloc(size_t size, size_t alignment)
+{
+    size_t page = mem_pagesize();
+    size_t extra = alignment > ALIGNMENT ? alignment : 0;
+    if (size > SIZE_MAX - HUGE_OFFSET - extra - page) return NULL;
+    size_t length = (size + HUGE_OFFSET + extra + page - 1) & ~(page - 1);
+    char *start = mem_map(length);
+    if (start == NULL) return NULL;
+
+    char *bp = start + HUGE_OFFSET;
+    if (extra != 0)
+    {
+        bp = (char *)(((uintptr_t)bp + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+        // The whole pages in front of the block are not needed
+        size_t unused = (size_t)(bp - HUGE_OFFSET - start) & ~(page - 1);
+        if (unused != 0) mem_unmap(start, unused);
+        start += unused;
+        length -= unused;
+    }
+    HUGE_LENGTH(bp) = length;
+    HUGE_LEAD(bp) = bp - HUGE_OFFSET - start;
+    PUT(HEADER_PTR(bp), PACK(0, MMAPPED | ALLOC));
+    return bp;
+}
+
+static void huge_free(void *bp) { mem_unmap(HUGE_START(bp), HUGE_LENGTH(bp)); }
+
+static void *huge_realloc(void *bp, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t lead = HUGE_LEAD(bp);
+    if (size > SIZE_MAX - lead - HUGE_OFFSET - page) return NULL;
+    size_t length = (lead + HUGE_OFFSET + size + page - 1) & ~(page - 1);
+    if (length == HUGE_LENGTH(bp)) return bp;
+
+    // Mapped blocks stay mapped when they shrink; mremap moves the pages rather than the bytes
+    char *start = mem_remap(HUGE_START(bp), HUGE_LENGTH(bp), length);
+    if (start == NULL) return NULL;
+    bp = start + lead + HUGE_OFFSET;
+    HUGE_LENGTH(bp) = length;
+    return bp;
+}
+#endif
+
+/*
+ * Free List Functionality
+ */
+
+#if MM_ENGINE == MM_ENGINE_SEGREGATED || MM_THREAD_SAFE
+static int get_list_index(word_t size)
+{
+    // MIN_BLOCK_SIZE..64 get a list per ALIGNMENT bytes, then list EXACT_LISTS + k holds sizes
+    // in (2^(6+k), 2^(7+k)]
+    if (size <= EXACT_LIST_MAX) return (size - MIN_BLOCK_SIZE) / ALIGNMENT;
+    return MIN(EXACT_LISTS + WORD_FLS(size - 1) - EXACT_LIST_MAX_LOG2, TREE_LIST);
+}
+#endif
+
+#if MM_COMPACT_LINKS
+static link_t link_offset(heap_t *h, void *bp)
+{
+    return bp != NULL ? (link_t)((char *)bp - h->lo) : 0;
+}
+#endif
+
+static void list_push(heap_t *h, void **head, void *bp)
+{
+    void *free_list_ptr = *head;
+
+    // Set prev and next for current block
+    PUT_LINK(h, NEXT_FREE_PTR(bp), free_list_ptr);
+    PUT_LINK(h, PREV_FREE_PTR(bp), NULL);
+
+    // Connect the rest of the list and update head
+    if (free_list_ptr != NULL) PUT_LINK(h, PREV_FREE_PTR(free_list_ptr), bp);
+
+    *head = bp;
+}
+
+// Unlinks bp from the list at head and returns whether the list is now empty
+static int list_remove(heap_t *h, void **head, void *bp)
+{
+    void *prev = prev_free(h, bp);
+    void *next = next_free(h, bp);
+    int empty = 0;
+
+    if (prev != NULL && next != NULL)
+    {
+        PUT_LINK(h, NEXT_FREE_PTR(prev), next);
+        PUT_LINK(h, PREV_FREE_PTR(next), prev);
+    }
+    else if (prev == NULL && next != NULL)
+    {
+        PUT_LINK(h, PREV_FREE_PTR(next), NULL);
+        *head = next;
+    }
+    else if (prev != NULL && next == NULL)
+    {
+        PUT_LINK(h, NEXT_FREE_PTR(prev), NULL);
+    }
+    else
+    {
+        *head = NULL;
+        empty = 1;
+    }
+
+    PUT_LINK(h, PREV_FREE_PTR(bp), NULL);
+    PUT_LINK(h, NEXT_FREE_PTR(bp), NULL);
+    return empty;
+}
+
+#if MM_ENGINE == MM_ENGINE_TLSF
+/*
+ * TLSF engine: every size maps to one (first level, second level) list and two bitmaps
+ * record which lists are non-empty, so insert, remove and search are all O(1).
+ */
+
+static void tlsf_mapping(word_t size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        // Small sizes share first level 0, one second-level list per 8 bytes
+        *fl = 0;
+        *sl = size / ALIGNMENT;
+    }
+    else
+    {
+        int msb = WORD_FLS(size);
+        *fl = msb - FL_INDEX_SHIFT + 1;
+        *sl = (size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+    }
+}
+
+static void *good_fit(heap_t *h, word_t size)
+{
+    // Round up to the next list boundary so that any block in the chosen list fits
+    if (size >= SMALL_BLOCK_SIZE)
+    {
+        word_t round = ((word_t)1 << (WORD_FLS(size) - SL_INDEX_COUNT_LOG2)) - 1;
+        if (size > WORD_MAX - round) return NULL;
+        size += round;
+    }
+
+    int fl, sl;
+    tlsf_mapping(size, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT) return NULL;
+
+    // Look in the same first-level range first, then in the next non-empty one
+    uint32_t sl_map = h->sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0)
+    {
+        word_t fl_map = fl + 1 < FL_INDEX_COUNT ? h->fl_bitmap & (~(word_t)0 << (fl + 1)) : 0;
+        if (fl_map == 0) return NULL;
+        fl = WORD_FFS(fl_map);
+        sl_map = h->sl_bitmap[fl];
+    }
+    return h->tlsf_lists[fl][__builtin_ctz(sl_map)];
+}
+
+static void insert_free(heap_t *h, void *bp)
+{
+    int fl, sl;
+    tlsf_mapping(GET_SIZE(HEADER_PTR(bp)), &fl, &sl);
+    list_push(h, &h->tlsf_lists[fl][sl], bp);
+    h->fl_bitmap |= (word_t)1 << fl;
+    h->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(heap_t *h, void *bp)
+{
+    int fl, sl;
+    tlsf_mapping(GET_SIZE(HEADER_PTR(bp)), &fl, &sl);
+    if (list_remove(h, &h->tlsf_lists[fl][sl], bp))
+    {
+        h->sl_bitmap[fl] &= ~(1u << sl);
+        if (h->sl_bitmap[fl] == 0) h->fl_bitmap &= ~((word_t)1 << fl);
+    }
+}
+#else
+static void *first_fit(heap_t *h, word_t size)
+{
+    // Visit only non-empty lists, lowest candidate first
+    uint32_t lists = h->nonempty_lists & (~0u << get_list_index(size));
+    for (; lists != 0; lists &= lists - 1)
+    {
+        int idx = __builtin_ctz(lists);
+        if (idx == TREE_LIST) return tree_best_fit(h, h->segregated_lists[idx], size);
+
+        void *bp = h->segregated_lists[idx];
+        while (bp != NULL)
+        {
+            if (GET_SIZE(HEADER_PTR(bp)) >= size) return bp;
+            bp = next_free(h, bp);
+        }
+    }
+    return NULL;
+}
+
+static void insert_free(heap_t *h, void *bp)
+{
+    int idx = get_list_index(GET_SIZE(HEADER_PTR(bp)));
+    if (idx == TREE_LIST)
+        h->segregated_lists[idx] = tree_insert(h, h->segregated_lists[idx], bp);
+    else
+        list_push(h, &h->segregated_lists[idx], bp);
+    h->nonempty_lists |= 1u << idx;
+}
+
+static void remove_free(heap_t *h, void *bp)
+{
+    int idx = get_list_index(GET_SIZE(HEADER_PTR(bp)));
+    if (idx == TREE_LIST)
+    {
+        h->segregated_lists[idx] = tree_delete(h, h->segregated_lists[idx], bp);
+        PUT_LINK(h, TREE_LEFT(bp), NULL);
+        PUT_LINK(h, TREE_RIGHT(bp), NULL);
+        if (h->segregated_lists[idx] == NULL) h->nonempty_lists &= ~(1u << idx);
+    }
+    else if (list_remove(h, &h->segregated_lists[idx], bp))
+    {
+        h->nonempty_lists &= ~(1u << idx);
+    }
+}
+
+/*
+ * Large Block Tree
+ *
+ * Blocks in TREE_LIST form a treap ordered by (size, address) with priorities hashed from the
+ * block address, which keeps it balanced in expectation and gives O(log n) best fit.
+ */
+
+static int tree_less(void *a, void *b)
+{
+    word_t a_size = GET_SIZE(HEADER_PTR(a));
+    word_t b_size = GET_SIZE(HEADER_PTR(b));
+    return a_size < b_size || (a_size == b_size && (char *)a < (char *)b);
+}
+
+static uint32_t tree_priority(void *bp) { return (uint32_t)((uintptr_t)bp >> 3) * 2654435761u; }
+
+static void *tree_insert(heap_t *h, void *root, void *bp)
+{
+    if (root == NULL)
+    {
+        PUT_LINK(h, TREE_LEFT(bp), NULL);
+        PUT_LINK(h, TREE_RIGHT(bp), NULL);
+        return bp;
+    }
+
+    if (tree_less(bp, root))
+    {
+        void *left = tree_insert(h, GET_LINK(h, TREE_LEFT(root)), bp);
+        PUT_LINK(h, TREE_LEFT(root), left);
+        if (tree_priority(left) > tree_priority(root))
+        {
+            // Rotate right
+            PUT_LINK(h, TREE_LEFT(root), GET_LINK(h, TREE_RIGHT(left)));
+            PUT_LINK(h, TREE_RIGHT(left), root);
+            return left;
+        }
+    }
+    else
+    {
+        void *right = tree_insert(h, GET_LINK(h, TREE_RIGHT(root)), bp);
+        PUT_LINK(h, TREE_RIGHT(root), right);
+        if (tree_priority(right) > tree_priority(root))
+        {
+            // Rotate left
+            PUT_LINK(h, TREE_RIGHT(root), GET_LINK(h, TREE_LEFT(right)));
+            PUT_LINK(h, TREE_LEFT(right), root);
+            return right;
+        }
+    }
+    return root;
+}
+
+static void *tree_delete(heap_t *h, void *root, void *bp)
+{
+    if (root == bp) return tree_merge(h, GET_LINK(h, TREE_LEFT(root)), GET_LINK(h, TREE_RIGHT(root)));
+
+    if (tree_less(bp, root))
+        PUT_LINK(h, TREE_LEFT(root), tree_delete(h, GET_LINK(h, TREE_LEFT(root)), bp));
+    else
+        PUT_LINK(h, TREE_RIGHT(root), tree_delete(h, GET_LINK(h, TREE_RIGHT(root)), bp));
+    return root;
+}
+
+// Joins two treaps where every block in left orders before every block in right
+static void *tree_merge(heap_t *h, void *left, void *right)
+{
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    if (tree_priority(left) > tree_priority(right))
+    {
+        PUT_LINK(h, TREE_RIGHT(left), tree_merge(h, GET_LINK(h, TREE_RIGHT(left)), right));
+        return left;
+    }
+    PUT_LINK(h, TREE_LEFT(right), tree_merge(h, left, GET_LINK(h, TREE_LEFT(right))));
+    return right;
+}
+
+// Returns the smallest block of at least size bytes, lowest address first among equal sizes
+static void *tree_best_fit(heap_t *h, void *root, word_t size)
+{
+    void *best = NULL;
+    while (root != NULL)
+    {
+        if (GET_SIZE(HEADER_PTR(root)) >= size)
+        {
+            best = root;
+            root = GET_LINK(h, TREE_LEFT(root));
+        }
+        else
+        {
+            root = GET_LINK(h, TREE_RIGHT(root));
+        }
+    }
+    return best;
+}
+#endif
+
+static void *next_free(heap_t *h, void *bp)
+{
+    if (bp == NULL) return NULL;
+    return GET_LINK(h, NEXT_FREE_PTR(bp));
+}
+
+static void *prev_free(heap_t *h, void *bp)
+{
+    if (bp == NULL) return NULL;
+    return GET_LINK(h, PREV_FREE_PTR(bp));
+}
+
+/*
+ * Slabs
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes are served from page-aligned slabs, each an allocated
+ * heap block holding a header and an array of equal-sized objects with a free bitmap. A bitmap
+ * per heap marks slab pages, so mm_free can tell slab objects from boundary-tagged blocks.
+ */
+
+#if MM_SLAB
+// Frees read the page bitmap without the heap lock, so its words are only accessed atomically
+static slab_t *slab_of(heap_t *h, void *bp)
+{
+    size_t page = ((char *)bp - __atomic_load_n(&h->lo, __ATOMIC_RELAXED)) / SLAB_SIZE;
+    uint64_t pages = __atomic_load_n(&h->slab_pages[page / 64], __ATOMIC_RELAXED);
+    if ((pages & (1ull << (page % 64))) == 0) return NULL;
+    return (slab_t *)((uintptr_t)bp & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static slab_t *slab_create(heap_t *h, uint32_t obj_size)
+{
+    slab_t *slab = malloc_aligned(h, SLAB_SIZE, SLAB_BLOCK_SIZE);
+    if (slab == NULL) return NULL;
+
+    slab->obj_size = obj_size;
+    slab->capacity = (SLAB_SIZE - SLAB_OBJECTS) / obj_size;
+    slab->free_count = slab->capacity;
+    memset(slab->free_map, 0, sizeof(slab->free_map));
+    for (uint32_t i = 0; i < slab->capacity; ++i) slab->free_map[i / 64] |= 1ull << (i % 64);
+
+    size_t page = ((char *)slab - h->lo) / SLAB_SIZE;
+    __atomic_fetch_or(&h->slab_pages[page / 64], 1ull << (page % 64), __ATOMIC_RELAXED);
+    slab_link(h, slab);
+    return slab;
+}
+
+static void *slab_alloc(heap_t *h, size_t size)
+{
+    slab_t *slab = h->partial_slabs[SLAB_CLASS(size)];
+    if (slab == NULL && (slab = slab_create(h, ALIGN(size))) == NULL) return NULL;
+
+    // Take the lowest free object
+    int word = 0;
+    while (slab->free_map[word] == 0) ++word;
+    int bit = __builtin_ctzll(slab->free_map[word]);
+    slab->free_map[word] &= slab->free_map[word] - 1;
+    if (--slab->free_count == 0) slab_unlink(h, slab);
+
+    return (char *)slab + SLAB_OBJECTS + (word * 64 + bit) * slab->obj_size;
+}
+
+static void slab_free(heap_t *h, slab_t *slab, void *bp)
+{
+    uint32_t idx = ((char *)bp - (char *)slab - SLAB_OBJECTS) / slab->obj_size;
+    slab->free_map[idx / 64] |= 1ull << (idx % 64);
+    if (slab->free_count++ == 0) slab_link(h, slab);
+    if (slab->free_count < slab->capacity) return;
+
+    // Give an empty slab back to the heap unless it is the last one of its class
+    slab_t **head = &h->partial_slabs[SLAB_CLASS(slab->obj_size)];
+    if (*head == slab && slab->next == NULL) return;
+    slab_unlink(h, slab);
+    size_t page = ((char *)slab - h->lo) / SLAB_SIZE;
+    __atomic_fetch_and(&h->slab_pages[page / 64], ~(1ull << (page % 64)), __ATOMIC_RELAXED);
+    free_block(h, slab);
+}
+
+static void slab_link(heap_t *h, slab_t *slab)
+{
+    slab_t **head = &h->partial_slabs[SLAB_CLASS(slab->obj_size)];
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head != NULL) (*head)->prev = slab;
+    *head = slab;
+}
+
+static void slab_unlink(heap_t *h, slab_t *slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        h->partial_slabs[SLAB_CLASS(slab->obj_size)] = slab->next;
+    if (slab->next != NULL) slab->next->prev = slab->prev;
+}
+#endif
+
+/*
+ * Thread Cache
+ *
+ * Freed blocks of the smallest size classes stay allocated and are parked on a per-thread
+ * LIFO, linked through their first payload word. Only misses and overflow take a heap lock.
+ */
+
+#if MM_THREAD_SAFE
+static tcache_t *tcache_acquire(void)
+{
+    tcache_t *cache = &tcache;
+    uint32_t epoch = __atomic_load_n(&heap_epoch, __ATOMIC_ACQUIRE);
+    if (cache->epoch != epoch)
+    {
+        // Blocks cached before the last mm_init belong to a heap that no longer exists
+        for (int i = 0; i < TCACHE_SLOTS; ++i)
+        {
+            cache->head[i] = NULL;
+            cache->count[i] = 0;
+        }
+        cache->epoch = epoch;
+    }
+    if (!cache->registered)
+    {
+        // Register the cache so it is flushed back to the heaps when the thread exits
+        pthread_once(&tcache_key_once, tcache_make_key);
+        pthread_setspecific(tcache_key, cache);
+        cache->registered = 1;
+    }
+    return cache;
+}
+
+// Cache slot for requests of size bytes, or -1 if they bypass the cache
+static int tcache_index(size_t size)
+{
+#if MM_SLAB
+    if (size <= SLAB_MAX_SIZE) return TCACHE_CLASSES + SLAB_CLASS(size);
+#endif
+    if (size > CHUNK_SIZE) return -1;
+    int idx = get_list_index(ADJUST_SIZE(size));
+    return idx < TCACHE_CLASSES ? idx : -1;
+}
+
+static void *tcache_get(size_t size)
+{
+    int idx = tcache_index(size);
+    if (idx < 0) return NULL;
+    tcache_t *cache = tcache_acquire();
+
+    // Blocks in the 128/256 bins vary in size, so look for the first one that fits
+    int binned = idx == TCACHE_CLASSES - 1 || idx == TCACHE_CLASSES - 2;
+    word_t aligned_size = ADJUST_SIZE(size);
+    void **link = &cache->head[idx];
+    while (binned && *link != NULL && GET_SIZE(HEADER_PTR(*link)) < aligned_size)
+        link = (void **)*link;
+    void *bp = *link;
+    if (bp != NULL)
+    {
+        *link = GET_PTR(bp);
+        cache->count[idx]--;
+        return bp;
+    }
+    if (binned) return NULL;
+
+    // Exact class miss: take one block for the caller and refill the cache in the same lock
+    heap_t *h = heap_for_thread();
+    if (h == NULL) return NULL;
+    LOCK(h);
+    bp = heap_malloc(h, size);
+    for (int i = 1; bp != NULL && i < TCACHE_REFILL; ++i)
+    {
+        void *extra = heap_malloc(h, size);
+        if (extra == NULL) break;
+        PUT_PTR(extra, cache->head[idx]);
+        cache->head[idx] = extra;
+        cache->count[idx]++;
+    }
+    UNLOCK(h);
+    return bp;
+}
+
+static void tcache_put(void *bp, int idx)
+{
+    tcache_t *cache = tcache_acquire();
+
+    if (cache->count[idx] >= TCACHE_MAX_COUNT) tcache_flush(cache, idx, TCACHE_MAX_COUNT / 2);
+    PUT_PTR(bp, cache->head[idx]);
+    cache->head[idx] = bp;
+    cache->count[idx]++;
+}
+
+static void tcache_flush(tcache_t *cache, int idx, uint32_t keep)
+{
+    // Return all but the most recently freed keep blocks to the heaps that own them
+    void **link = &cache->head[idx];
+    for (uint32_t i = 0; i < keep && *link != NULL; ++i) link = (void **)*link;
+
+    void *bp = *link;
+    *link = NULL;
+    cache->count[idx] = MIN(cache->count[idx], keep);
+
+    heap_t *locked = NULL;
+    while (bp != NULL)
+    {
+        void *next = GET_PTR(bp);
+        heap_t *h = heap_of(bp);
+        if (h != thread_heap)
+        {
+            // A run of blocks from another heap is already linked, so it goes on that heap's
+            // remote-free list as a whole
+            void *last = bp;
+            while (next != NULL && heap_of(next) == h)
+            {
+                last = next;
+                next = GET_PTR(next);
+            }
+            remote_push(h, bp, last);
+            bp = next;
+            continue;
+        }
+        if (h != locked)
+        {
+            // Runs of blocks from the same heap share one lock acquisition
+            if (locked != NULL) UNLOCK(locked);
+            LOCK(h);
+            locked = h;
+        }
+        heap_free(h, bp);
+        bp = next;
+    }
+    if (locked != NULL) UNLOCK(locked);
+}
+
+static void tcache_destroy(void *arg)
+{
+    tcache_t *cache = arg;
+    if (cache->epoch != __atomic_load_n(&heap_epoch, __ATOMIC_ACQUIRE)) return;
+    for (int i = 0; i < TCACHE_SLOTS; ++i) tcache_flush(cache, i, 0);
+}
+
+static void tcache_make_key(void) { pthread_key_create(&tcache_key, tcache_destroy); }
+
+/*
+ * Remote Frees
+ *
+ * A block freed by a thread of another heap is pushed on its owner's remote-free list with a
+ * single compare-and-swap instead of taking the owner's lock. Whoever next allocates from the
+ * owner, holding its lock, takes the whole list with one exchange and frees it in a batch. Blocks
+ * stay marked allocated while they wait. Since nothing pops single blocks off the list, a pushed
+ * head that is freed and reused in the meantime (ABA) cannot corrupt it, and the links need no
+ * tags.
+ */
+
+// Pushes the chain of blocks first..last, linked through their payloads, onto h's list
+static void remote_push(heap_t *h, void *first, void *last)
+{
+    void *head = __atomic_load_n(&h->remote_free, __ATOMIC_RELAXED);
+    do
+    {
+        PUT_PTR(last, head);
+    } while (!__atomic_compare_exchange_n(&h->remote_free, &head, first, 1, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+// Frees every block waiting on h's list; the caller holds h's lock
+static void remote_drain(heap_t *h)
+{
+    if (__atomic_load_n(&h->remote_free, __ATOMIC_RELAXED) == NULL) return;
+    void *bp = __atomic_exchange_n(&h->remote_free, NULL, __ATOMIC_ACQUIRE);
+    while (bp != NULL)
+    {
+        void *next = GET_PTR(bp);
+        heap_free(h, bp);
+        bp = next;
+    }
+}
+
+/*
+ * Fork
+ *
+ * fork copies the heaps as they are, so it must not happen while another thread holds a heap
+ * lock halfway through an update. Every lock is taken before the fork and released after it;
+ * the child, now single-threaded, starts over with fresh locks.
+ */
+
+static void atfork_register(void) { pthread_atfork(fork_prepare, fork_parent, fork_child); }
+
+static void fork_prepare(void)
+{
+    for (int i = 0; i < NUM_HEAPS; ++i) LOCK(&heaps[i]);
+}
+
+static void fork_parent(void)
+{
+    for (int i = NUM_HEAPS; i-- > 0;) UNLOCK(&heaps[i]);
+}
+
+static void fork_child(void)
+{
+    for (int i = 0; i < NUM_HEAPS; ++i) pthread_mutex_init(&heaps[i].lock, NULL);
+}
+#endif
+
+/*
+ * Printers
+ */
+
+static void print_heap_list(heap_t *h)
+{
+    printf("HEAP LIST:\n");
+    void *bp = h->heap_list_ptr;
+    while (GET_SIZE(HEADER_PTR(bp)) != 0)
+    {
+        word_t size = GET_SIZE(HEADER_PTR(bp));
+        word_t allocated = GET_ALLOC(HEADER_PTR(bp));
+        printf("%lu, %lu\n", (unsigned long)allocated, (unsigned long)size);
+        bp = NEXT_BLOCK_PTR(bp);
+    }
+    printf("\n");
+}
+
+static void print_free_list(heap_t *h, void *free_list_ptr)
+{
+    printf("FREE LIST: ");
+    void *bp = free_list_ptr;
+    while (bp != NULL)
+    {
+        word_t size = GET_SIZE(HEADER_PTR(bp));
+        printf("(size: %lu, addr: %p, prev: %p, next: %p) ", (unsigned long)size, bp,
+               GET_LINK(h, PREV_FREE_PTR(bp)), GET_LINK(h, NEXT_FREE_PTR(bp)));
+        bp = next_free(h, bp);
+    }
+    printf("\n");
+}
+
+#if MM_ENGINE == MM_ENGINE_TLSF
+static void print_tlsf_lists(heap_t *h)
+{
+    printf("--- TLSF LISTS ---\n");
+    for (int fl = 0; fl < FL_INDEX_COUNT; ++fl)
+    {
+        for (int sl = 0; sl < SL_INDEX_COUNT; ++sl)
+        {
+            if (h->tlsf_lists[fl][sl] == NULL) continue;
+            printf("[%d][%d] ", fl, sl);
+            print_free_list(h, h->tlsf_lists[fl][sl]);
+        }
+    }
+    printf(" ---------------------- \n");
+}
+#else
+static void print_tree(heap_t *h, void *root)
+{
+    if (root == NULL) return;
+    print_tree(h, GET_LINK(h, TREE_LEFT(root)));
+    printf("(size: %lu, addr: %p) ", (unsigned long)GET_SIZE(HEADER_PTR(root)), root);
+    print_tree(h, GET_LINK(h, TREE_RIGHT(root)));
+}
+
+static void print_segregated_lists(heap_t *h)
+{
+    printf("--- SEGREGATED LIST ---\n");
+    for (int i = 0; i < TREE_LIST; ++i)
+    {
+        print_free_list(h, h->segregated_lists[i]);
+    }
+    printf("FREE TREE: ");
+    print_tree(h, h->segregated_lists[TREE_LIST]);
+    printf("\n");
+    printf(" ---------------------- \n");
+}
+#endif
\ No newline at end of file
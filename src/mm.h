@@ -1,9 +1,75 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Block layout, for callers that size requests to the allocator's classes. The values follow the
+ * flags mm.c is built with (-DALIGNMENT, -DMM_WIDE_HEADERS), so callers need the same flags.
+ */
+#ifdef ALIGNMENT
+#define MM_ALIGNMENT ALIGNMENT  /* every payload address is a multiple of this */
+#else
+#define MM_ALIGNMENT 8
+#endif
+#if MM_WIDE_HEADERS
+#define MM_HEADER_SIZE 8        /* header in front of every payload that is not a slab object */
+#else
+#define MM_HEADER_SIZE 4
+#endif
+#define MM_SLAB_MAX_SIZE 48     /* largest request served from a slab, without a header */
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern int mm_trim(size_t pad);
+
+/*
+ * Arenas: bump allocation released all at once (mm_arena.c)
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(size_t chunk_size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/*
+ * Pools: fixed-size objects reused last-freed first (mm_pool.c)
+ */
+typedef struct mm_pool mm_pool_t;
+
+typedef struct {
+    size_t obj_size;   /* bytes per object, after rounding up to the alignment */
+    size_t in_use;     /* objects taken and not yet put back */
+    size_t high_water; /* most objects in use at any one time */
+    size_t capacity;   /* objects the pool's chunks can hold */
+    size_t chunks;     /* chunks taken from the heap */
+} mm_pool_stats_t;
+
+extern mm_pool_t *mm_pool_create(size_t obj_size, size_t align);
+extern void *mm_pool_get(mm_pool_t *pool);
+extern void mm_pool_put(mm_pool_t *pool, void *obj);
+extern void mm_pool_stats(mm_pool_t *pool, mm_pool_stats_t *stats);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/*
+ * Shared library only: sets up the allocator on first use (mm_libc.c)
+ */
+extern int mm_ensure_init(void);
 
 
 /* 
@@ -21,3 +87,8 @@ typedef struct {
 
 extern team_t team;
 
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_H_ */
@@ -0,0 +1,148 @@
+/*
+ * mm_arena.c - Arenas: bump allocation from chunks of the main heap, released all at once.
+ *
+ * An arena hands out memory by bumping a pointer through a chain of equal chunks obtained with
+ * mm_malloc. Nothing is freed one allocation at a time: mm_arena_reset rewinds to the first
+ * chunk in O(1) and keeps the chain for reuse, and mm_arena_destroy returns every chunk to the
+ * heap. Requests larger than a chunk get a block of their own, which reset frees. An arena must
+ * not be used by more than one thread at a time.
+ */
+#include "mm.h"
+
+#include <stdint.h>
+
+#include "config.h"
+
+#define ARENA_ALIGNMENT ALIGNMENT     // same guarantee as mm_malloc
+#define ARENA_CHUNK_SIZE (64 * 1024)  // default chunk payload
+
+#define ARENA_ALIGN(size) (((size) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+typedef struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;  // bytes usable after the chunk header
+} arena_chunk_t;
+
+#define CHUNK_DATA(chunk) ((char *)(chunk) + ARENA_ALIGN(sizeof(arena_chunk_t)))
+
+struct mm_arena
+{
+    arena_chunk_t *first;    // chain of chunks, kept across resets
+    arena_chunk_t *current;  // chunk being bumped through
+    arena_chunk_t *large;    // blocks of oversized requests, freed on reset
+    char *ptr;               // next free byte in current
+    char *end;
+    size_t chunk_size;
+};
+
+static arena_chunk_t *chunk_create(size_t size, arena_chunk_t *next);
+static void chunk_enter(mm_arena_t *arena, arena_chunk_t *chunk);
+static void chunks_free(arena_chunk_t *chunk);
+
+/*
+ * mm_arena_create - Create an empty arena that grows by chunks of chunk_size bytes, or a
+ *     default size if chunk_size is 0. Returns NULL if out of memory.
+ */
+mm_arena_t *mm_arena_create(size_t chunk_size)
+{
+    mm_arena_t *arena = mm_malloc(sizeof(mm_arena_t));
+    if (arena == NULL) return NULL;
+    arena->first = arena->current = arena->large = NULL;
+    arena->ptr = arena->end = NULL;
+    arena->chunk_size = chunk_size != 0 ? ARENA_ALIGN(chunk_size) : ARENA_CHUNK_SIZE;
+    return arena;
+}
+
+/*
+ * mm_arena_alloc - Allocate size bytes from the arena. The memory stays valid until the arena
+ *     is reset or destroyed.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    if (size == 0 || size > SIZE_MAX - ARENA_ALIGNMENT) return NULL;
+    size = ARENA_ALIGN(size);
+
+    if (size > arena->chunk_size)
+    {
+        arena_chunk_t *large = chunk_create(size, arena->large);
+        if (large == NULL) return NULL;
+        arena->large = large;
+        return CHUNK_DATA(large);
+    }
+
+    if ((size_t)(arena->end - arena->ptr) < size)
+    {
+        // Move on to the next chunk of the chain, appending one at its end
+        arena_chunk_t *next = arena->current != NULL ? arena->current->next : arena->first;
+        if (next == NULL)
+        {
+            next = chunk_create(arena->chunk_size, NULL);
+            if (next == NULL) return NULL;
+            if (arena->current != NULL)
+                arena->current->next = next;
+            else
+                arena->first = next;
+        }
+        chunk_enter(arena, next);
+    }
+
+    void *p = arena->ptr;
+    arena->ptr += size;
+    return p;
+}
+
+/*
+ * mm_arena_reset - Release everything allocated from the arena at once. The chunks stay with
+ *     the arena and are bumped through again from the first.
+ */
+void mm_arena_reset(mm_arena_t *arena)
+{
+    chunks_free(arena->large);
+    arena->large = NULL;
+    arena->current = NULL;
+    arena->ptr = arena->end = NULL;
+}
+
+/*
+ * mm_arena_destroy - Return all of the arena's chunks and the arena itself to the heap.
+ */
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    if (arena == NULL) return;
+    chunks_free(arena->first);
+    chunks_free(arena->large);
+    mm_free(arena);
+}
+
+/*
+ * Static Helper Functions
+ */
+
+static arena_chunk_t *chunk_create(size_t size, arena_chunk_t *next)
+{
+    size_t header = ARENA_ALIGN(sizeof(arena_chunk_t));
+    if (size > SIZE_MAX - header) return NULL;
+    arena_chunk_t *chunk = mm_malloc(header + size);
+    if (chunk == NULL) return NULL;
+    chunk->next = next;
+    chunk->size = size;
+    return chunk;
+}
+
+static void chunk_enter(mm_arena_t *arena, arena_chunk_t *chunk)
+{
+    arena->current = chunk;
+    arena->ptr = CHUNK_DATA(chunk);
+    arena->end = arena->ptr + chunk->size;
+}
+
+static void chunks_free(arena_chunk_t *chunk)
+{
+    while (chunk != NULL)
+    {
+        arena_chunk_t *next = chunk->next;
+        mm_free(chunk);
+        chunk = next;
+    }
+}
@@ -0,0 +1,260 @@
+/*
+ * mm_copy.c - Copy and zero kernels for moving and clearing block payloads.
+ *
+ * Payloads start 8-byte aligned and run from a few words to many megabytes. On x86 the kernels
+ * use 32-byte AVX2 or 16-byte SSE2 vectors, chosen on first use, and from
+ * MM_COPY_STREAM_THRESHOLD bytes up they write with non-temporal stores, so relocating or
+ * clearing a large block does not evict the working set from the caches. Elsewhere they are
+ * memmove and memset.
+ */
+#include "mm_copy.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MM_COPY_X86 1
+#else
+#define MM_COPY_X86 0
+#endif
+
+// Copies and fills of at least this many bytes bypass the caches; 0 turns streaming off
+#ifndef MM_COPY_STREAM_THRESHOLD
+#define MM_COPY_STREAM_THRESHOLD (4 << 20)
+#endif
+
+typedef void (*copy_fn)(void *dst, const void *src, size_t n);
+typedef void (*zero_fn)(void *dst, size_t n);
+
+static void copy_first(void *dst, const void *src, size_t n);
+static void zero_first(void *dst, size_t n);
+static void pick_kernels(void);
+static int streams(size_t n);
+static int disjoint(const char *dst, const char *src, size_t n);
+
+static copy_fn copy_kernel = copy_first;
+static zero_fn zero_kernel = zero_first;
+
+/*
+ * mm_copy - Copy n bytes from src to dst, which may overlap src only from below.
+ */
+void mm_copy(void *dst, const void *src, size_t n)
+{
+    __atomic_load_n(&copy_kernel, __ATOMIC_RELAXED)(dst, src, n);
+}
+
+/*
+ * mm_zero - Zero n bytes at dst.
+ */
+void mm_zero(void *dst, size_t n) { __atomic_load_n(&zero_kernel, __ATOMIC_RELAXED)(dst, n); }
+
+/*
+ * Static Helper Functions
+ */
+
+// The first call through either entry point picks the kernels for this CPU
+static void copy_first(void *dst, const void *src, size_t n)
+{
+    pick_kernels();
+    mm_copy(dst, src, n);
+}
+
+static void zero_first(void *dst, size_t n)
+{
+    pick_kernels();
+    mm_zero(dst, n);
+}
+
+static int streams(size_t n) { return MM_COPY_STREAM_THRESHOLD > 0 && n >= MM_COPY_STREAM_THRESHOLD; }
+
+// Streaming copies align dst first, which may write ahead of where src has been read
+static int disjoint(const char *dst, const char *src, size_t n)
+{
+    return (uintptr_t)dst + n <= (uintptr_t)src || (uintptr_t)src + n <= (uintptr_t)dst;
+}
+
+static void copy_memmove(void *dst, const void *src, size_t n) { memmove(dst, src, n); }
+
+static void zero_memset(void *dst, size_t n) { memset(dst, 0, n); }
+
+#if MM_COPY_X86
+// The kernels load the first and last vector of src before storing anything and store them last,
+// unaligned. In between they run with stores aligned to dst, and every pass loads a group of
+// vectors before storing it, so copying forward stays correct when dst overlaps src from below.
+__attribute__((target("sse2"))) static void copy_sse2(void *dst, const void *src, size_t n)
+{
+    if (n < 16)
+    {
+        memmove(dst, src, n);
+        return;
+    }
+    __m128i first = _mm_loadu_si128((const __m128i *)src);
+    __m128i last = _mm_loadu_si128((const __m128i *)((const char *)src + n - 16));
+    size_t head = 16 - ((uintptr_t)dst & 15);
+    char *d = (char *)dst + head;
+    const char *s = (const char *)src + head;
+    size_t left = n - head;
+
+    if (streams(n) && disjoint(dst, src, n))
+    {
+        for (; left >= 64; left -= 64, d += 64, s += 64)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)s);
+            __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+            __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+            __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+            _mm_stream_si128((__m128i *)d, a);
+            _mm_stream_si128((__m128i *)(d + 16), b);
+            _mm_stream_si128((__m128i *)(d + 32), c);
+            _mm_stream_si128((__m128i *)(d + 48), e);
+        }
+        _mm_sfence();
+    }
+    for (; left >= 64; left -= 64, d += 64, s += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)s);
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_store_si128((__m128i *)d, a);
+        _mm_store_si128((__m128i *)(d + 16), b);
+        _mm_store_si128((__m128i *)(d + 32), c);
+        _mm_store_si128((__m128i *)(d + 48), e);
+    }
+    for (; left >= 16; left -= 16, d += 16, s += 16)
+    {
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+    }
+    _mm_storeu_si128((__m128i *)((char *)dst + n - 16), last);
+    _mm_storeu_si128((__m128i *)dst, first);
+}
+
+__attribute__((target("sse2"))) static void zero_sse2(void *dst, size_t n)
+{
+    if (n < 16)
+    {
+        memset(dst, 0, n);
+        return;
+    }
+    __m128i z = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i *)dst, z);
+    _mm_storeu_si128((__m128i *)((char *)dst + n - 16), z);
+    size_t head = 16 - ((uintptr_t)dst & 15);
+    char *d = (char *)dst + head;
+    size_t left = n - head;
+
+    if (streams(n))
+    {
+        for (; left >= 64; left -= 64, d += 64)
+        {
+            _mm_stream_si128((__m128i *)d, z);
+            _mm_stream_si128((__m128i *)(d + 16), z);
+            _mm_stream_si128((__m128i *)(d + 32), z);
+            _mm_stream_si128((__m128i *)(d + 48), z);
+        }
+        _mm_sfence();
+    }
+    for (; left >= 16; left -= 16, d += 16) _mm_store_si128((__m128i *)d, z);
+}
+
+__attribute__((target("avx2"))) static void copy_avx2(void *dst, const void *src, size_t n)
+{
+    if (n < 32)
+    {
+        copy_sse2(dst, src, n);
+        return;
+    }
+    __m256i first = _mm256_loadu_si256((const __m256i *)src);
+    __m256i last = _mm256_loadu_si256((const __m256i *)((const char *)src + n - 32));
+    size_t head = 32 - ((uintptr_t)dst & 31);
+    char *d = (char *)dst + head;
+    const char *s = (const char *)src + head;
+    size_t left = n - head;
+
+    if (streams(n) && disjoint(dst, src, n))
+    {
+        for (; left >= 128; left -= 128, d += 128, s += 128)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)s);
+            __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+            __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+            _mm256_stream_si256((__m256i *)d, a);
+            _mm256_stream_si256((__m256i *)(d + 32), b);
+            _mm256_stream_si256((__m256i *)(d + 64), c);
+            _mm256_stream_si256((__m256i *)(d + 96), e);
+        }
+        _mm_sfence();
+    }
+    for (; left >= 128; left -= 128, d += 128, s += 128)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_store_si256((__m256i *)d, a);
+        _mm256_store_si256((__m256i *)(d + 32), b);
+        _mm256_store_si256((__m256i *)(d + 64), c);
+        _mm256_store_si256((__m256i *)(d + 96), e);
+    }
+    for (; left >= 32; left -= 32, d += 32, s += 32)
+    {
+        _mm256_store_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+    }
+    _mm256_storeu_si256((__m256i *)((char *)dst + n - 32), last);
+    _mm256_storeu_si256((__m256i *)dst, first);
+    _mm256_zeroupper();
+}
+
+__attribute__((target("avx2"))) static void zero_avx2(void *dst, size_t n)
+{
+    if (n < 32)
+    {
+        zero_sse2(dst, n);
+        return;
+    }
+    __m256i z = _mm256_setzero_si256();
+    _mm256_storeu_si256((__m256i *)dst, z);
+    _mm256_storeu_si256((__m256i *)((char *)dst + n - 32), z);
+    size_t head = 32 - ((uintptr_t)dst & 31);
+    char *d = (char *)dst + head;
+    size_t left = n - head;
+
+    if (streams(n))
+    {
+        for (; left >= 128; left -= 128, d += 128)
+        {
+            _mm256_stream_si256((__m256i *)d, z);
+            _mm256_stream_si256((__m256i *)(d + 32), z);
+            _mm256_stream_si256((__m256i *)(d + 64), z);
+            _mm256_stream_si256((__m256i *)(d + 96), z);
+        }
+        _mm_sfence();
+    }
+    for (; left >= 32; left -= 32, d += 32) _mm256_store_si256((__m256i *)d, z);
+    _mm256_zeroupper();
+}
+#endif
+
+// Racing threads all pick the same kernels, so plain relaxed stores are enough
+static void pick_kernels(void)
+{
+    copy_fn copy = copy_memmove;
+    zero_fn zero = zero_memset;
+#if MM_COPY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        copy = copy_avx2;
+        zero = zero_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        copy = copy_sse2;
+        zero = zero_sse2;
+    }
+#endif
+    __atomic_store_n(&copy_kernel, copy, __ATOMIC_RELAXED);
+    __atomic_store_n(&zero_kernel, zero, __ATOMIC_RELAXED);
+}
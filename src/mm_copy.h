@@ -0,0 +1,11 @@
+/*
+ * mm_copy.h - Copy and zero kernels for block payloads, picked for the CPU at run time
+ */
+
+#include <stddef.h>
+
+/* Copies n bytes from src to dst; the two may overlap only if dst is below src */
+void mm_copy(void *dst, const void *src, size_t n);
+
+/* Zeroes n bytes at dst */
+void mm_zero(void *dst, size_t n);
@@ -0,0 +1,113 @@
+/*
+ * mm_libc.c - The C library allocation functions on top of mm.c, for build/libmm.so.
+ *
+ * The library is built thread-safe over real memory (memlib.c with MEM_OS) and can replace the
+ * system allocator with LD_PRELOAD. The allocator is set up by whichever call comes first, which
+ * may be from the dynamic loader or a constructor, so nothing here may itself allocate. Like
+ * glibc, a request for 0 bytes gets a unique pointer, and failures set errno to ENOMEM.
+ */
+#include "mm.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "memlib.h"
+
+static int ready;  // set once mm_init has run
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init(void);
+static void *check(void *bp);
+
+void *malloc(size_t size)
+{
+    if (!mm_ensure_init()) return NULL;
+    return check(mm_malloc(size != 0 ? size : 1));
+}
+
+void free(void *ptr) { mm_free(ptr); }
+
+void *realloc(void *ptr, size_t size)
+{
+    if (!mm_ensure_init()) return NULL;
+    if (size == 0 && ptr != NULL)
+    {
+        mm_free(ptr);
+        return NULL;
+    }
+    return check(mm_realloc(ptr, size != 0 ? size : 1));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (!mm_ensure_init()) return NULL;
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) return check(NULL);
+    if (bytes == 0) nmemb = size = 1;
+    return check(mm_calloc(nmemb, size));
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) return check(NULL);
+    return realloc(ptr, bytes);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (!mm_ensure_init()) return ENOMEM;
+    return mm_posix_memalign(memptr, alignment, size != 0 ? size : 1);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (!mm_ensure_init()) return NULL;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return check(mm_aligned_alloc(alignment, size != 0 ? size : 1));
+}
+
+// Obsolete, but still called by some programs, and glibc's versions would use its own heap
+void *memalign(size_t alignment, size_t size) { return aligned_alloc(alignment, size); }
+
+void *valloc(size_t size) { return aligned_alloc(mem_pagesize(), size); }
+
+size_t malloc_usable_size(void *ptr) { return mm_usable_size(ptr); }
+
+int malloc_trim(size_t pad) { return mm_trim(pad); }
+
+/*
+ * mm_ensure_init - Set up the allocator on the first call. Returns 0, with errno set, if that
+ *     failed. Other entry points of the library, such as operator new, call it first as well.
+ */
+int mm_ensure_init(void)
+{
+    if (__builtin_expect(__atomic_load_n(&ready, __ATOMIC_ACQUIRE), 1)) return 1;
+    pthread_once(&init_once, init);
+    if (__atomic_load_n(&ready, __ATOMIC_ACQUIRE)) return 1;
+    errno = ENOMEM;
+    return 0;
+}
+
+/*
+ * Static Helper Functions
+ */
+
+static void init(void)
+{
+    mem_init();
+    if (mm_init() == 0) __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+}
+
+// Sets errno for a failed allocation
+static void *check(void *bp)
+{
+    if (bp == NULL) errno = ENOMEM;
+    return bp;
+}
@@ -0,0 +1,116 @@
+/*
+ * mm_new.cpp - Replacements for every global operator new and delete, for build/libmm++.so.
+ *
+ * Plain, array, nothrow and std::align_val_t forms all allocate from the heaps through
+ * mm_malloc and mm_memalign. A failed allocation runs the new handler and retries, as the
+ * standard requires, and throws std::bad_alloc when there is none. The sized forms of delete
+ * pass the size on to mm_free_sized, which skips the slab lookup for anything larger than a
+ * slab object.
+ */
+#include <cstddef>
+#include <new>
+
+#include "mm.h"
+
+static void *allocate(std::size_t size, std::size_t alignment);
+static void *allocate_nothrow(std::size_t size, std::size_t alignment) noexcept;
+
+void *operator new(std::size_t size) { return allocate(size, 0); }
+
+void *operator new[](std::size_t size) { return allocate(size, 0); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept { mm_free(ptr); }
+
+void operator delete[](void *ptr) noexcept { mm_free(ptr); }
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { mm_free(ptr); }
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { mm_free(ptr); }
+
+void operator delete(void *ptr, std::size_t size) noexcept { mm_free_sized(ptr, size); }
+
+void operator delete[](void *ptr, std::size_t size) noexcept { mm_free_sized(ptr, size); }
+
+void operator delete(void *ptr, std::align_val_t) noexcept { mm_free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t) noexcept { mm_free(ptr); }
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { mm_free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t) noexcept
+{
+    mm_free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t) noexcept
+{
+    mm_free_sized(ptr, size);
+}
+
+/*
+ * Static Helper Functions
+ */
+
+// Allocates size bytes aligned to alignment (0 for the default), calling the new handler until
+// the allocation succeeds or there is no handler left
+static void *allocate(std::size_t size, std::size_t alignment)
+{
+    if (size == 0) size = 1;
+    for (;;)
+    {
+        void *bp = nullptr;
+        if (mm_ensure_init()) bp = alignment != 0 ? mm_memalign(alignment, size) : mm_malloc(size);
+        if (bp != nullptr) return bp;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void *allocate_nothrow(std::size_t size, std::size_t alignment) noexcept
+{
+    try
+    {
+        return allocate(size, alignment);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
@@ -0,0 +1,226 @@
+/*
+ * mm_pmr.h - C++ adaptors: std::pmr memory resources over the heaps, arenas and pools, and a
+ * stateless STL allocator with size classes chosen at compile time. mm_init must have run before
+ * any of them allocates; the shared library does that on first use.
+ */
+
+#ifndef __MM_PMR_H_
+#define __MM_PMR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+#include "mm.h"
+
+namespace mm
+{
+
+/* Alignment every mm_malloc block has; larger alignments go through mm_memalign */
+constexpr std::size_t heap_alignment = MM_ALIGNMENT;
+
+/* Request size for a single object of size bytes. Slab objects and blocks of up to 64 bytes
+ * already have a class per alignment step. The thread cache keeps blocks of up to 128 and up to
+ * 256 bytes in one bin each, so those requests are raised to fill the bin's largest block, which
+ * any block cached there fits. Larger sizes are left alone. */
+constexpr std::size_t size_class(std::size_t size)
+{
+    if (size <= MM_SLAB_MAX_SIZE) return size;
+    std::size_t block = (size + MM_HEADER_SIZE + heap_alignment - 1) & ~(heap_alignment - 1);
+    if (block <= 64) return size;
+    if (block <= 128) return 128 - MM_HEADER_SIZE;
+    if (block <= 256) return 256 - MM_HEADER_SIZE;
+    return size;
+}
+
+/* Allocates from the heaps, or throws std::bad_alloc */
+inline void *heap_allocate(std::size_t bytes, std::size_t alignment)
+{
+    if (bytes == 0) bytes = 1;
+    void *p = alignment <= heap_alignment ? mm_malloc(bytes) : mm_memalign(alignment, bytes);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+inline void heap_deallocate(void *p, std::size_t bytes) noexcept
+{
+    mm_free_sized(p, bytes != 0 ? bytes : 1);
+}
+
+/*
+ * heap_resource - mm_malloc and mm_free as a memory resource. All instances are interchangeable;
+ *     heap() returns a shared one.
+ */
+class heap_resource : public std::pmr::memory_resource
+{
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return heap_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t) override
+    {
+        heap_deallocate(p, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return dynamic_cast<const heap_resource *>(&other) != nullptr;
+    }
+};
+
+inline heap_resource *heap() noexcept
+{
+    static heap_resource resource;
+    return &resource;
+}
+
+/*
+ * arena_resource - Bump allocation from an mm arena. Deallocation does nothing; release() frees
+ *     everything at once and keeps the arena's chunks for reuse. Not thread-safe.
+ */
+class arena_resource : public std::pmr::memory_resource
+{
+  public:
+    explicit arena_resource(std::size_t chunk_size = 0) : arena_(mm_arena_create(chunk_size))
+    {
+        if (arena_ == nullptr) throw std::bad_alloc();
+    }
+    arena_resource(const arena_resource &) = delete;
+    arena_resource &operator=(const arena_resource &) = delete;
+    ~arena_resource() override { mm_arena_destroy(arena_); }
+
+    void release() noexcept { mm_arena_reset(arena_); }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        // Over-allocate for alignments past the arena's own and round the address up
+        std::size_t extra = alignment > heap_alignment ? alignment - heap_alignment : 0;
+        void *p = mm_arena_alloc(arena_, (bytes != 0 ? bytes : 1) + extra);
+        if (p == nullptr) throw std::bad_alloc();
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(p);
+        return reinterpret_cast<void *>((addr + alignment - 1) & ~std::uintptr_t(alignment - 1));
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    mm_arena_t *arena_;
+};
+
+/*
+ * pool_resource - One mm pool per power-of-two size class from 16 bytes to 1 KB, created on
+ *     first use. Larger or over-aligned requests go to the heaps. Not thread-safe.
+ */
+class pool_resource : public std::pmr::memory_resource
+{
+  public:
+    static constexpr int classes = 7;  // 16, 32, ... 1024 bytes
+    static constexpr std::size_t max_pooled = std::size_t(16) << (classes - 1);
+
+    pool_resource() noexcept : pools_() {}
+    pool_resource(const pool_resource &) = delete;
+    pool_resource &operator=(const pool_resource &) = delete;
+    ~pool_resource() override
+    {
+        for (mm_pool_t *pool : pools_) mm_pool_destroy(pool);
+    }
+
+    /* Counters of the pool serving requests of bytes bytes; all zero if it was never used */
+    mm_pool_stats_t stats(std::size_t bytes) const noexcept
+    {
+        mm_pool_stats_t stats = {};
+        if (bytes <= max_pooled && pools_[class_of(bytes)] != nullptr)
+            mm_pool_stats(pools_[class_of(bytes)], &stats);
+        return stats;
+    }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes > max_pooled || alignment > heap_alignment)
+            return heap_allocate(bytes, alignment);
+
+        int c = class_of(bytes);
+        if (pools_[c] == nullptr && (pools_[c] = mm_pool_create(std::size_t(16) << c, 0)) == nullptr)
+            throw std::bad_alloc();
+        void *p = mm_pool_get(pools_[c]);
+        if (p == nullptr) throw std::bad_alloc();
+        return p;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes > max_pooled || alignment > heap_alignment)
+            heap_deallocate(p, bytes);
+        else
+            mm_pool_put(pools_[class_of(bytes)], p);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    static int class_of(std::size_t bytes) noexcept
+    {
+        return bytes <= 16 ? 0 : 64 - __builtin_clzll(bytes - 1) - 4;
+    }
+
+    mm_pool_t *pools_[classes];
+};
+
+/*
+ * allocator - Stateless std::allocator replacement over the heaps. Single objects, such as the
+ *     nodes of node-based containers, are rounded up to their size class at compile time and
+ *     freed with their size, which lets large ones skip the slab lookup.
+ */
+template <typename T>
+struct allocator
+{
+    using value_type = T;
+
+    static constexpr std::size_t object_size = size_class(sizeof(T));
+
+    allocator() noexcept = default;
+    template <typename U>
+    allocator(const allocator<U> &) noexcept
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        if (n > std::size_t(-1) / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T *>(heap_allocate(n == 1 ? object_size : n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        heap_deallocate(p, n == 1 ? object_size : n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return false;
+}
+
+}  // namespace mm
+
+#endif /* __MM_PMR_H_ */
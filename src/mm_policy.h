@@ -0,0 +1,545 @@
+/*
+ * mm_policy.h - The segregated-fit allocator of mm.c as a C++ template, with the size classes, the
+ * fit strategy, the split rule and the header layout chosen at compile time.
+ *
+ * allocator_core keeps mm.c's design: only free blocks carry a footer, each header records
+ * whether the block before it is allocated, free blocks sit on doubly linked lists per size class
+ * with a bitmap of the non-empty ones, frees coalesce immediately, and the heap grows by what its
+ * free tail block lacks. Every policy is a type, so each combination compiles to an allocator of
+ * its own with no runtime dispatch, and the class of small sizes comes from a table built at
+ * compile time. A core runs on a memlib heap and is not thread-safe.
+ */
+
+#ifndef __MM_POLICY_H_
+#define __MM_POLICY_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+extern "C"
+{
+#include "memlib.h"
+}
+
+namespace mm
+{
+
+constexpr std::size_t round_up(std::size_t size, std::size_t align)
+{
+    return (size + align - 1) & ~(align - 1);
+}
+
+constexpr int floor_log2(std::size_t x) { return x <= 1 ? 0 : 63 - __builtin_clzll(x); }
+
+/*
+ * Header layouts: the type of a header or footer word and the payload alignment
+ */
+
+struct narrow_header
+{
+    using word = std::uint32_t;
+    static constexpr std::size_t alignment = 8;
+    static std::string name() { return "narrow"; }
+};
+
+struct wide_header
+{
+    using word = std::uint64_t;
+    static constexpr std::size_t alignment = 16;
+    static std::string name() { return "wide"; }
+};
+
+/*
+ * Size class policies: count classes, and compute() maps a block size to one of them. A larger
+ * size never gets a smaller class, so a search can start at the request's class and move up.
+ */
+
+// One class per Step bytes up to ExactMax, then one per power of two; sizes past 2^TopLog2 share
+// the last class (mm.c's lists, without the tree)
+template <std::size_t Step, std::size_t ExactMax, int TopLog2>
+struct exact_then_log2
+{
+    static_assert((ExactMax & (ExactMax - 1)) == 0 && ExactMax % Step == 0, "bad exact range");
+    static constexpr int exact = ExactMax / Step;
+    static constexpr int count = exact + TopLog2 - floor_log2(ExactMax) + 1;
+
+    static constexpr int compute(std::size_t size)
+    {
+        if (size <= ExactMax) return size == 0 ? 0 : (size - 1) / Step;
+        int c = exact + floor_log2(size - 1) - floor_log2(ExactMax);
+        return c < count ? c : count - 1;
+    }
+
+    static std::string name()
+    {
+        return "exact" + std::to_string(Step) + "-" + std::to_string(ExactMax) + "+log2";
+    }
+};
+
+// One class per power of two, from sizes up to 2^MinLog2 to sizes past 2^TopLog2
+template <int MinLog2, int TopLog2>
+struct log2_classes
+{
+    static constexpr int count = TopLog2 - MinLog2 + 1;
+
+    static constexpr int compute(std::size_t size)
+    {
+        if (size <= (std::size_t(1) << MinLog2)) return 0;
+        int c = floor_log2(size - 1) + 1 - MinLog2;
+        return c < count ? c : count - 1;
+    }
+
+    static std::string name() { return "log2"; }
+};
+
+// Classes of every size up to Max in steps of Step, looked up instead of computed
+template <typename Classes, std::size_t Step, std::size_t Max>
+struct class_table
+{
+    static constexpr std::array<std::uint8_t, Max / Step + 1> make()
+    {
+        std::array<std::uint8_t, Max / Step + 1> table{};
+        for (std::size_t i = 0; i < table.size(); ++i) table[i] = Classes::compute(i * Step);
+        return table;
+    }
+
+    static constexpr std::array<std::uint8_t, Max / Step + 1> table = make();
+
+    // size must be a multiple of Step
+    static int index(std::size_t size)
+    {
+        return size <= Max ? table[size / Step] : Classes::compute(size);
+    }
+};
+
+/*
+ * Split policies: whether place() gives the remainder bytes after an allocation back as a free
+ * block of their own
+ */
+
+struct always_split
+{
+    static constexpr bool split(std::size_t remainder, std::size_t min_block)
+    {
+        return remainder >= min_block;
+    }
+    static std::string name() { return "split"; }
+};
+
+// Leaves remainders below Bytes inside the block, trading internal fragmentation for fewer tiny
+// free blocks
+template <std::size_t Bytes>
+struct split_above
+{
+    static constexpr bool split(std::size_t remainder, std::size_t min_block)
+    {
+        return remainder >= min_block && remainder >= Bytes;
+    }
+    static std::string name() { return "split>=" + std::to_string(Bytes); }
+};
+
+/*
+ * Blocks: boundary tags and free-list links for a header layout
+ */
+
+template <typename Header>
+struct block
+{
+    using word = typename Header::word;
+    static constexpr std::size_t wsize = sizeof(word);
+    static constexpr word alloc_bit = 0x1;
+    static constexpr word prev_alloc_bit = 0x2;
+
+    static word *header(void *bp)
+    {
+        return reinterpret_cast<word *>(static_cast<char *>(bp) - wsize);
+    }
+    static word *footer(void *bp)
+    {
+        return reinterpret_cast<word *>(static_cast<char *>(bp) + size(bp) - 2 * wsize);
+    }
+    static std::size_t size(void *bp) { return *header(bp) & ~word(0x7); }
+    static bool allocated(void *bp) { return *header(bp) & alloc_bit; }
+    static bool prev_allocated(void *bp) { return *header(bp) & prev_alloc_bit; }
+    static word prev_bit(void *bp) { return *header(bp) & prev_alloc_bit; }
+
+    // neighbors in memory; the previous block must be free, so its footer is there to read
+    static void *next(void *bp) { return static_cast<char *>(bp) + size(bp); }
+    static void *prev(void *bp)
+    {
+        char *p = static_cast<char *>(bp);
+        return p - (*reinterpret_cast<word *>(p - 2 * wsize) & ~word(0x7));
+    }
+
+    static void set(void *bp, std::size_t size, word bits) { *header(bp) = word(size) | bits; }
+    static void set_free(void *bp, std::size_t size, word bits)
+    {
+        set(bp, size, bits);
+        *footer(bp) = word(size);
+    }
+
+    static void *&next_free(void *bp) { return static_cast<void **>(bp)[0]; }
+    static void *&prev_free(void *bp) { return static_cast<void **>(bp)[1]; }
+};
+
+/*
+ * free_lists - One LIFO list of free blocks per size class and a bitmap of the non-empty ones
+ */
+template <typename Header, typename Classes>
+class free_lists
+{
+  public:
+    using blk = block<Header>;
+    using table = class_table<Classes, Header::alignment, 4096>;
+    static constexpr int count = Classes::count;
+    static_assert(count <= 64, "the non-empty bitmap holds 64 classes");
+
+    void clear()
+    {
+        heads_.fill(nullptr);
+        nonempty_ = 0;
+    }
+
+    static int class_of(std::size_t size) { return table::index(size); }
+
+    // First non-empty class at or after cls, or -1
+    int first_nonempty(int cls) const
+    {
+        if (cls >= count) return -1;
+        std::uint64_t mask = nonempty_ & (~std::uint64_t(0) << cls);
+        return mask != 0 ? __builtin_ctzll(mask) : -1;
+    }
+
+    void *head(int cls) const { return heads_[cls]; }
+
+    void insert(void *bp)
+    {
+        int cls = class_of(blk::size(bp));
+        blk::next_free(bp) = heads_[cls];
+        blk::prev_free(bp) = nullptr;
+        if (heads_[cls] != nullptr) blk::prev_free(heads_[cls]) = bp;
+        heads_[cls] = bp;
+        nonempty_ |= std::uint64_t(1) << cls;
+    }
+
+    void remove(void *bp)
+    {
+        void *next = blk::next_free(bp);
+        void *prev = blk::prev_free(bp);
+        if (next != nullptr) blk::prev_free(next) = prev;
+        if (prev != nullptr)
+        {
+            blk::next_free(prev) = next;
+            return;
+        }
+        int cls = class_of(blk::size(bp));
+        heads_[cls] = next;
+        if (next == nullptr) nonempty_ &= ~(std::uint64_t(1) << cls);
+    }
+
+  private:
+    std::array<void *, count> heads_{};
+    std::uint64_t nonempty_ = 0;
+};
+
+/*
+ * Fit policies: find() returns a free block of at least size bytes, still on its list, or
+ * nullptr. The core reports every block that leaves the lists through removed().
+ */
+
+// The first block that fits, searching classes upward from the request's
+struct first_fit
+{
+    template <typename Lists>
+    void *find(const Lists &lists, std::size_t size)
+    {
+        using blk = typename Lists::blk;
+        for (int c = lists.first_nonempty(Lists::class_of(size)); c >= 0;
+             c = lists.first_nonempty(c + 1))
+        {
+            for (void *bp = lists.head(c); bp != nullptr; bp = blk::next_free(bp))
+            {
+                if (blk::size(bp) >= size) return bp;
+            }
+        }
+        return nullptr;
+    }
+    void removed(void *) {}
+    void reset() {}
+    static std::string name() { return "first"; }
+};
+
+// The smallest block that fits in the first class holding one; later classes only have larger
+// blocks, so that is the smallest overall
+struct best_fit
+{
+    template <typename Lists>
+    void *find(const Lists &lists, std::size_t size)
+    {
+        using blk = typename Lists::blk;
+        for (int c = lists.first_nonempty(Lists::class_of(size)); c >= 0;
+             c = lists.first_nonempty(c + 1))
+        {
+            void *best = nullptr;
+            std::size_t best_size = 0;
+            for (void *bp = lists.head(c); bp != nullptr; bp = blk::next_free(bp))
+            {
+                std::size_t s = blk::size(bp);
+                if (s < size || (best != nullptr && s >= best_size)) continue;
+                best = bp;
+                best_size = s;
+                if (s == size) break;
+            }
+            if (best != nullptr) return best;
+        }
+        return nullptr;
+    }
+    void removed(void *) {}
+    void reset() {}
+    static std::string name() { return "best"; }
+};
+
+// First fit that resumes where the last search in the same class stopped
+struct next_fit
+{
+    template <typename Lists>
+    void *find(const Lists &lists, std::size_t size)
+    {
+        using blk = typename Lists::blk;
+        for (int c = lists.first_nonempty(Lists::class_of(size)); c >= 0;
+             c = lists.first_nonempty(c + 1))
+        {
+            void *start = rover_ != nullptr && rover_class_ == c ? rover_ : lists.head(c);
+            for (void *bp = start; bp != nullptr; bp = blk::next_free(bp))
+            {
+                if (blk::size(bp) >= size) return take(bp, c);
+            }
+            for (void *bp = lists.head(c); bp != start; bp = blk::next_free(bp))
+            {
+                if (blk::size(bp) >= size) return take(bp, c);
+            }
+        }
+        return nullptr;
+    }
+    void removed(void *bp)
+    {
+        if (bp == rover_) rover_ = nullptr;
+    }
+    void reset() { rover_ = nullptr; }
+    static std::string name() { return "next"; }
+
+  private:
+    void *take(void *bp, int cls)
+    {
+        rover_ = *static_cast<void **>(bp);  // the block after bp on its list
+        rover_class_ = cls;
+        return bp;
+    }
+
+    void *rover_ = nullptr;
+    int rover_class_ = 0;
+};
+
+/*
+ * allocator_core - malloc, free and realloc on one memlib heap. ChunkSize is the free space the
+ *     heap starts with; after that it grows by exactly what a request lacks.
+ */
+template <typename Header, typename Classes, typename Fit, typename Split,
+          std::size_t ChunkSize = 4096>
+class allocator_core
+{
+  public:
+    using lists_type = free_lists<Header, Classes>;
+    using blk = block<Header>;
+    using word = typename blk::word;
+    static constexpr std::size_t wsize = blk::wsize;
+    static constexpr std::size_t alignment = Header::alignment;
+    static constexpr std::size_t min_block = round_up(2 * wsize + 2 * sizeof(void *), alignment);
+
+    explicit allocator_core(mem_heap_t *mem) : mem_(mem) {}
+
+    static std::string name()
+    {
+        return Header::name() + " " + Classes::name() + " " + Fit::name() + " " + Split::name();
+    }
+
+    // Starts over on an empty heap; returns 0, or -1 if the heap cannot hold the first chunk
+    int init()
+    {
+        mem_heap_reset_brk(mem_);
+        lists_.clear();
+        fit_.reset();
+
+        char *start = static_cast<char *>(mem_heap_sbrk(mem_, 4 * wsize));
+        if (start == reinterpret_cast<char *>(-1)) return -1;
+        std::memset(start, 0, wsize);                                          // padding
+        blk::set(start + 2 * wsize, 2 * wsize, blk::prev_alloc_bit | blk::alloc_bit);  // prologue
+        *reinterpret_cast<word *>(start + 2 * wsize) = word(2 * wsize) | blk::alloc_bit;
+        blk::set(start + 4 * wsize, 0, blk::prev_alloc_bit | blk::alloc_bit);  // epilogue
+        return extend(round_up(ChunkSize, alignment)) != nullptr ? 0 : -1;
+    }
+
+    void *malloc(std::size_t size)
+    {
+        if (size == 0 || size > max_request) return nullptr;
+        std::size_t asize = adjust(size);
+        void *bp = fit_.find(lists_, asize);
+        if (bp == nullptr && (bp = extend_to(asize)) == nullptr) return nullptr;
+        remove(bp);
+        place(bp, asize);
+        return bp;
+    }
+
+    void free(void *bp)
+    {
+        if (bp == nullptr) return;
+        std::size_t size = blk::size(bp);
+        blk::set_free(bp, size, blk::prev_bit(bp));
+        clear_prev_alloc(blk::next(bp));
+        coalesce(bp);
+    }
+
+    void *realloc(void *bp, std::size_t size)
+    {
+        if (bp == nullptr) return malloc(size);
+        if (size == 0)
+        {
+            free(bp);
+            return nullptr;
+        }
+        if (size > max_request) return nullptr;
+
+        std::size_t asize = adjust(size);
+        std::size_t cur = blk::size(bp);
+        void *next = blk::next(bp);
+
+        // A block at the end of the heap, or before its free tail, grows by extending the heap
+        void *end = blk::allocated(next) ? next : blk::next(next);
+        if (asize > cur && blk::size(end) == 0)
+        {
+            std::size_t have = cur + (end != next ? blk::size(next) : 0);
+            if (have < asize) extend(std::max(asize - have, min_block));
+            next = blk::next(bp);
+        }
+
+        // Grow into a free next block
+        if (asize > cur && !blk::allocated(next) && cur + blk::size(next) >= asize)
+        {
+            remove(next);
+            cur += blk::size(next);
+            blk::set(bp, cur, blk::prev_bit(bp) | blk::alloc_bit);
+            set_prev_alloc(blk::next(bp));
+        }
+
+        if (asize <= cur)
+        {
+            // Give the tail back when the split policy wants it
+            if (Split::split(cur - asize, min_block))
+            {
+                blk::set(bp, asize, blk::prev_bit(bp) | blk::alloc_bit);
+                void *rest = blk::next(bp);
+                blk::set(rest, cur - asize, blk::prev_alloc_bit | blk::alloc_bit);
+                free(rest);
+            }
+            return bp;
+        }
+
+        void *moved = malloc(size);
+        if (moved == nullptr) return nullptr;
+        std::memcpy(moved, bp, cur - wsize);
+        free(bp);
+        return moved;
+    }
+
+  private:
+    static constexpr std::size_t max_request = std::size_t(~word(0) / 2);
+
+    static constexpr std::size_t adjust(std::size_t size)
+    {
+        return std::max(round_up(size + wsize, alignment), min_block);
+    }
+
+    static void set_prev_alloc(void *bp) { *blk::header(bp) |= blk::prev_alloc_bit; }
+    static void clear_prev_alloc(void *bp) { *blk::header(bp) &= ~blk::prev_alloc_bit; }
+
+    void remove(void *bp)
+    {
+        lists_.remove(bp);
+        fit_.removed(bp);
+    }
+
+    // Grows the heap by size bytes and returns the new free block, merged with a free tail
+    void *extend(std::size_t size)
+    {
+        void *bp = mem_heap_sbrk(mem_, static_cast<std::intptr_t>(size));
+        if (bp == reinterpret_cast<void *>(-1)) return nullptr;
+        blk::set_free(bp, size, blk::prev_bit(bp));  // the old epilogue becomes the header
+        blk::set(blk::next(bp), 0, blk::alloc_bit);
+        return coalesce(bp);
+    }
+
+    // A free block of at least size bytes at the end of the heap
+    void *extend_to(std::size_t size)
+    {
+        void *brk = mem_heap_sbrk(mem_, 0);
+        std::size_t tail = 0;
+        if (!blk::prev_allocated(brk))
+        {
+            tail = blk::size(blk::prev(brk));
+            if (tail >= size) return blk::prev(brk);
+        }
+        return extend(std::max(size - tail, min_block));
+    }
+
+    // Merges a free block with free neighbors and puts the result on its list
+    void *coalesce(void *bp)
+    {
+        std::size_t size = blk::size(bp);
+        void *next = blk::next(bp);
+        if (!blk::allocated(next))
+        {
+            remove(next);
+            size += blk::size(next);
+        }
+        if (!blk::prev_allocated(bp))
+        {
+            void *prev = blk::prev(bp);
+            remove(prev);
+            size += blk::size(prev);
+            bp = prev;
+        }
+        blk::set_free(bp, size, blk::prev_alloc_bit);
+        lists_.insert(bp);
+        return bp;
+    }
+
+    // Allocates asize bytes of the free block bp, which is already off its list
+    void place(void *bp, std::size_t asize)
+    {
+        std::size_t size = blk::size(bp);
+        if (Split::split(size - asize, min_block))
+        {
+            blk::set(bp, asize, blk::prev_bit(bp) | blk::alloc_bit);
+            void *rest = blk::next(bp);
+            blk::set_free(rest, size - asize, blk::prev_alloc_bit);
+            lists_.insert(rest);
+        }
+        else
+        {
+            blk::set(bp, size, blk::prev_bit(bp) | blk::alloc_bit);
+            set_prev_alloc(blk::next(bp));
+        }
+    }
+
+    mem_heap_t *mem_;
+    lists_type lists_;
+    Fit fit_;
+};
+
+}  // namespace mm
+
+#endif /* __MM_POLICY_H_ */
@@ -0,0 +1,146 @@
+/*
+ * mm_pool.c - Pools of fixed-size objects drawn from the main heap in whole chunks.
+ *
+ * Objects carry no header. A freed object goes on an intrusive LIFO stack linked through its
+ * first word, so the next get reuses the most recently freed, cache-hot object. When the stack
+ * is empty objects are carved from the newest chunk, and when that runs out the pool takes
+ * another chunk from the heap with mm_memalign. Chunks go back only when the pool is destroyed.
+ * A pool must not be used by more than one thread at a time.
+ */
+#include "mm.h"
+
+#include <stdint.h>
+
+#include "config.h"
+
+#define POOL_CHUNK_SIZE (16 * 1024)  // bytes per chunk, unless that holds too few objects
+#define POOL_MIN_OBJECTS 8           // objects per chunk at least
+#define POOL_MIN_ALIGN ALIGNMENT     // same guarantee as mm_malloc
+
+#define ALIGN_UP(size, align) (((size) + ((align) - 1)) & ~(size_t)((align) - 1))
+
+typedef struct pool_chunk
+{
+    struct pool_chunk *next;
+} pool_chunk_t;
+
+struct mm_pool
+{
+    void *free;   // top of the free stack; each free object holds the next one
+    char *carve;  // next never-used object in the newest chunk
+    char *carve_end;
+    pool_chunk_t *chunks;
+    size_t stride;  // object size rounded up to the alignment
+    size_t align;
+    size_t chunk_size;
+    size_t first;  // offset of the first object in a chunk
+    mm_pool_stats_t stats;
+};
+
+static int pool_grow(mm_pool_t *pool);
+
+/*
+ * mm_pool_create - Create a pool of obj_size-byte objects aligned to align, a power of two, or
+ *     to mm_malloc's alignment if align is 0. Returns NULL if the arguments are invalid or out of
+ *     memory.
+ */
+mm_pool_t *mm_pool_create(size_t obj_size, size_t align)
+{
+    if (align == 0) align = POOL_MIN_ALIGN;
+    if ((align & (align - 1)) != 0 || align > POOL_CHUNK_SIZE) return NULL;
+    if (align < POOL_MIN_ALIGN) align = POOL_MIN_ALIGN;
+    if (obj_size == 0 || obj_size > POOL_CHUNK_SIZE) return NULL;
+
+    mm_pool_t *pool = mm_malloc(sizeof(mm_pool_t));
+    if (pool == NULL) return NULL;
+    pool->free = NULL;
+    pool->carve = pool->carve_end = NULL;
+    pool->chunks = NULL;
+    pool->stride = ALIGN_UP(obj_size < sizeof(void *) ? sizeof(void *) : obj_size, align);
+    pool->align = align;
+    pool->first = ALIGN_UP(sizeof(pool_chunk_t), align);
+    pool->chunk_size = pool->first + pool->stride * POOL_MIN_OBJECTS;
+    if (pool->chunk_size < POOL_CHUNK_SIZE) pool->chunk_size = POOL_CHUNK_SIZE;
+
+    pool->stats.obj_size = pool->stride;
+    pool->stats.in_use = 0;
+    pool->stats.high_water = 0;
+    pool->stats.capacity = 0;
+    pool->stats.chunks = 0;
+    return pool;
+}
+
+/*
+ * mm_pool_get - Take an object from the pool, or NULL if the heap is out of memory.
+ */
+void *mm_pool_get(mm_pool_t *pool)
+{
+    void *obj = pool->free;
+    if (obj != NULL)
+    {
+        pool->free = *(void **)obj;
+    }
+    else
+    {
+        if ((size_t)(pool->carve_end - pool->carve) < pool->stride && pool_grow(pool) < 0)
+            return NULL;
+        obj = pool->carve;
+        pool->carve += pool->stride;
+    }
+
+    if (++pool->stats.in_use > pool->stats.high_water) pool->stats.high_water = pool->stats.in_use;
+    return obj;
+}
+
+/*
+ * mm_pool_put - Return an object taken from the same pool.
+ */
+void mm_pool_put(mm_pool_t *pool, void *obj)
+{
+    if (obj == NULL) return;
+    *(void **)obj = pool->free;
+    pool->free = obj;
+    --pool->stats.in_use;
+}
+
+/*
+ * mm_pool_stats - Copy the pool's counters to stats.
+ */
+void mm_pool_stats(mm_pool_t *pool, mm_pool_stats_t *stats) { *stats = pool->stats; }
+
+/*
+ * mm_pool_destroy - Return all of the pool's chunks and the pool itself to the heap. Objects
+ *     still in use become invalid.
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    if (pool == NULL) return;
+    pool_chunk_t *chunk = pool->chunks;
+    while (chunk != NULL)
+    {
+        pool_chunk_t *next = chunk->next;
+        mm_free(chunk);
+        chunk = next;
+    }
+    mm_free(pool);
+}
+
+/*
+ * Static Helper Functions
+ */
+
+// Takes a new chunk from the heap and makes it the one objects are carved from
+static int pool_grow(mm_pool_t *pool)
+{
+    pool_chunk_t *chunk = mm_memalign(pool->align, pool->chunk_size);
+    if (chunk == NULL) return -1;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    pool->carve = (char *)chunk + pool->first;
+    size_t count = (pool->chunk_size - pool->first) / pool->stride;
+    pool->carve_end = pool->carve + count * pool->stride;
+    pool->stats.capacity += count;
+    ++pool->stats.chunks;
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * mm_stress.c - Randomized consistency check of the allocator on the simulated heap.
+ *
+ * A table of slots is filled and emptied in random order: an empty slot gets a new block from
+ * mm_malloc, mm_calloc or mm_memalign, and a full one is either freed or reallocated to a new
+ * random size. Most requests are small, but some reach into the segregated lists' largest bins
+ * and the treap of large free blocks, and mm_trim gives the free end of the heap back every few
+ * thousand operations. A calloc'd block must read as zero, which tests the clean watermark after
+ * frees and trims. Aligned blocks must be aligned, and no block may be smaller than requested
+ * according to mm_usable_size. Every block is filled with a pattern derived from its slot and
+ * size. The pattern is checked before the block is freed or reallocated, and realloc must keep it
+ * up to the smaller of the two sizes. Each round starts over with a fresh heap. The first
+ * mismatch is reported and the exit status is 1.
+ *
+ * usage: mm_stress [-n ops_per_round] [-r rounds] [-s seed]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define SLOTS 1000
+#define TRIM_INTERVAL 4096  // operations between calls to mm_trim
+
+typedef struct
+{
+    unsigned char *p;
+    size_t size;
+} slot_t;
+
+static slot_t slots[SLOTS];
+static uint32_t state;
+
+static int run_round(long ops);
+static int allocate(slot_t *s, uint32_t r);
+static int check(const slot_t *s, size_t len, const char *what);
+static void fill(slot_t *s);
+static unsigned char pattern(const slot_t *s);
+static size_t random_size(void);
+static uint32_t next_random(void);
+
+int main(int argc, char **argv)
+{
+    long ops = 200000;
+    int rounds = 3;
+    state = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:s:")) != -1)
+    {
+        if (c == 'n')
+            ops = atol(optarg);
+        else if (c == 'r')
+            rounds = atoi(optarg);
+        else if (c == 's')
+            state = (uint32_t)strtoul(optarg, NULL, 0);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n ops_per_round] [-r rounds] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ops <= 0 || rounds <= 0 || state == 0) return 1;
+
+    mem_init();
+    for (int r = 0; r < rounds; ++r)
+    {
+        mem_reset_brk();
+        if (mm_init() < 0)
+        {
+            fprintf(stderr, "round %d: mm_init failed\n", r);
+            return 1;
+        }
+        if (run_round(ops) < 0)
+        {
+            fprintf(stderr, "round %d failed\n", r);
+            return 1;
+        }
+    }
+    printf("%d rounds of %ld operations ok, peak heap %zu bytes\n", rounds, ops,
+           mem_peak_heapsize());
+    return 0;
+}
+
+/*
+ * Static Helper Functions
+ */
+
+// Runs ops random operations on a fresh heap and frees whatever is left; returns -1 on an error
+static int run_round(long ops)
+{
+    memset(slots, 0, sizeof(slots));
+    for (long i = 0; i < ops; ++i)
+    {
+        uint32_t r = next_random();
+        slot_t *s = &slots[r % SLOTS];
+        if (i % TRIM_INTERVAL == TRIM_INTERVAL - 1) mm_trim((r & 1) ? 0 : 4096);
+        if (s->p == NULL)
+        {
+            if (allocate(s, r >> 16) < 0) return -1;
+        }
+        else if ((r >> 16) % 3 == 0)
+        {
+            if (check(s, s->size, "realloc") < 0) return -1;
+            size_t size = random_size();
+            unsigned char *q = mm_realloc(s->p, size);
+            if (q == NULL)
+            {
+                fprintf(stderr, "realloc to %zu bytes failed\n", size);
+                return -1;
+            }
+            s->p = q;
+            if (check(s, size < s->size ? size : s->size, "after realloc") < 0) return -1;
+            s->size = size;
+            fill(s);
+        }
+        else
+        {
+            if (check(s, s->size, "free") < 0) return -1;
+            mm_free(s->p);
+            s->p = NULL;
+        }
+    }
+
+    for (int k = 0; k < SLOTS; ++k)
+    {
+        if (slots[k].p == NULL) continue;
+        if (check(&slots[k], slots[k].size, "final free") < 0) return -1;
+        mm_free(slots[k].p);
+    }
+    return 0;
+}
+
+// Gives an empty slot a new block of a random size from one of the allocation calls and fills it;
+// returns -1 if the block is missing, too small, misaligned or, from calloc, not zero
+static int allocate(slot_t *s, uint32_t r)
+{
+    size_t size = random_size();
+    size_t alignment = 0;
+    int zeroed = 0;
+    const char *what;
+    if (r % 8 < 5)
+    {
+        what = "malloc";
+        s->p = mm_malloc(size);
+    }
+    else if (r % 8 < 7)
+    {
+        what = "calloc";
+        zeroed = 1;
+        size_t nmemb = (r >> 3) & 1 ? size : 1;
+        s->p = mm_calloc(nmemb, size / nmemb);
+        size = size / nmemb * nmemb;
+    }
+    else
+    {
+        what = "memalign";
+        alignment = (size_t)32 << ((r >> 3) % 7);
+        s->p = mm_memalign(alignment, size);
+    }
+    s->size = size;
+
+    if (s->p == NULL)
+    {
+        fprintf(stderr, "%s of %zu bytes failed\n", what, size);
+        return -1;
+    }
+    if (mm_usable_size(s->p) < size || (alignment != 0 && (uintptr_t)s->p % alignment != 0))
+    {
+        fprintf(stderr, "%s of %zu bytes returned a bad block at %p\n", what, size, (void *)s->p);
+        return -1;
+    }
+    if (zeroed)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (s->p[i] != 0)
+            {
+                fprintf(stderr, "calloc of %zu bytes at %p: byte %zu is not zero\n", size,
+                        (void *)s->p, i);
+                return -1;
+            }
+        }
+    }
+    fill(s);
+    return 0;
+}
+
+// Returns 0 if the first len bytes of a slot's block still hold its pattern, otherwise reports it
+static int check(const slot_t *s, size_t len, const char *what)
+{
+    unsigned char expect = pattern(s);
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (s->p[i] != expect)
+        {
+            fprintf(stderr, "%s: block of %zu bytes at %p differs at byte %zu\n", what, s->size,
+                    (void *)s->p, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void fill(slot_t *s) { memset(s->p, pattern(s), s->size); }
+
+static unsigned char pattern(const slot_t *s)
+{
+    return (unsigned char)((s - slots) * 7 + s->size) | 1;
+}
+
+// Mostly small requests, with a tail of large ones that the simulated heap can still hold
+static size_t random_size(void)
+{
+    uint32_t r = next_random();
+    uint32_t pick = r % 100;
+    r >>= 8;
+    if (pick < 50) return 1 + r % 64;
+    if (pick < 80) return 1 + r % 2048;
+    if (pick < 97) return 1 + r % 32768;
+    return 1 + r % 100000;
+}
+
+// xorshift32
+static uint32_t next_random(void)
+{
+    uint32_t x = state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return state = x;
+}
@@ -0,0 +1,314 @@
+/*
+ * mt_bench.c - Multithreaded checks and throughput for the thread-safe allocator, on the C
+ * library malloc as well for comparison.
+ *
+ * Two workloads run at 1, 2, 4, ... threads up to the maximum:
+ *   local - each thread allocates and frees objects of 16 to 256 bytes of its own, keeping a
+ *           small working set, which is the thread cache's fast path
+ *   cross - threads pass blocks of 16 bytes to 4 KB to the next thread through mailboxes, so
+ *           most frees and reallocs happen on a thread other than the one that allocated, which
+ *           goes through the heaps' remote-free lists
+ * Every block holds its size in its first word and a tag in its last byte, which are checked
+ * before the block is reallocated or freed; realloc must keep both. Any mismatch is reported and
+ * the exit status is 1. Throughput is millions of mallocs, frees and reallocs per second over all
+ * threads, and speedup is relative to one thread on the same allocator. The allocator runs over
+ * real memory (memlib.c built with MEM_OS), not the simulated heap.
+ *
+ * usage: mt_bench [-t max_threads] [-n ops_per_thread]
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define MAX_THREADS 256
+#define WORKING_SET 64     // blocks each thread of the local workload keeps alive
+#define MAILBOX_SLOTS 256  // blocks in flight to each thread of the cross workload
+
+typedef struct
+{
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+} allocator_t;
+
+typedef struct
+{
+    void *slot[MAILBOX_SLOTS];
+} mailbox_t;
+
+typedef struct
+{
+    const allocator_t *alloc;
+    int id;
+    int nthreads;
+    long ops;      // filled in by the thread: operations done,
+    double start;  // and when it started and finished them
+    double end;
+} worker_t;
+
+static const allocator_t allocators[] = {
+    {"mm", mm_malloc, mm_free, mm_realloc},
+    {"libc", malloc, free, realloc},
+};
+
+static int max_threads = 32;
+static long ops_per_thread = 500000;
+static pthread_barrier_t start_line;
+static mailbox_t mailboxes[MAX_THREADS];
+static long errors;
+
+static void *local_worker(void *arg);
+static void *cross_worker(void *arg);
+static double run(const allocator_t *alloc, void *(*work)(void *), int nthreads);
+static void drain_mailboxes(const allocator_t *alloc, int nthreads);
+
+static void stamp(unsigned char *p, size_t size);
+static int check(const unsigned char *p, const char *what);
+static uint32_t next_random(uint32_t *state);
+static double now(void);
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "t:n:")) != -1)
+    {
+        if (c == 't')
+            max_threads = atoi(optarg);
+        else if (c == 'n')
+            ops_per_thread = atol(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-t max_threads] [-n ops_per_thread]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads <= 0 || max_threads > MAX_THREADS || ops_per_thread <= 0) return 1;
+
+    mem_init();
+    if (mm_init() < 0)
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    struct
+    {
+        const char *name;
+        void *(*work)(void *);
+    } workloads[] = {{"local", local_worker}, {"cross", cross_worker}};
+
+    printf("%ld operations per thread, Mops/s (speedup over 1 thread)\n\n", ops_per_thread);
+    printf("%-8s %8s", "workload", "threads");
+    for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); ++a)
+        printf(" %20s", allocators[a].name);
+    printf("\n");
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w)
+    {
+        double base[sizeof(allocators) / sizeof(allocators[0])];
+        for (int n = 1;; n = n * 2 < max_threads ? n * 2 : max_threads)
+        {
+            printf("%-8s %8d", workloads[w].name, n);
+            for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); ++a)
+            {
+                double mops = run(&allocators[a], workloads[w].work, n);
+                if (n == 1) base[a] = mops;
+                printf(" %12.1f (%5.2fx)", mops, mops / base[a]);
+            }
+            printf("\n");
+            fflush(stdout);
+            if (n == max_threads) break;
+        }
+    }
+
+    if (errors != 0)
+    {
+        printf("\n%ld corrupted blocks\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Static Helper Functions
+ */
+
+// Runs nthreads copies of work on alloc and returns millions of operations per second
+static double run(const allocator_t *alloc, void *(*work)(void *), int nthreads)
+{
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    pthread_barrier_init(&start_line, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; ++i)
+    {
+        workers[i] = (worker_t){alloc, i, nthreads, 0, 0, 0};
+        pthread_create(&threads[i], NULL, work, &workers[i]);
+    }
+    pthread_barrier_wait(&start_line);
+
+    // Time from the first thread's start to the last one's end, as the threads see it, since on
+    // few cores this thread may not run again until they are done
+    long ops = 0;
+    double start = 0, end = 0;
+    for (int i = 0; i < nthreads; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        ops += workers[i].ops;
+        if (i == 0 || workers[i].start < start) start = workers[i].start;
+        if (i == 0 || workers[i].end > end) end = workers[i].end;
+    }
+    pthread_barrier_destroy(&start_line);
+    drain_mailboxes(alloc, nthreads);
+    return ops / (end - start) / 1e6;
+}
+
+// Replaces a random block of a small working set: one free and one malloc per step
+static void *local_worker(void *arg)
+{
+    worker_t *w = arg;
+    const allocator_t *alloc = w->alloc;
+    uint32_t state = 2654435761u * (w->id + 1);
+    unsigned char *live[WORKING_SET] = {NULL};
+
+    pthread_barrier_wait(&start_line);
+    w->start = now();
+    long ops = 0;
+    while (ops < ops_per_thread)
+    {
+        uint32_t r = next_random(&state);
+        unsigned char **slot = &live[r % WORKING_SET];
+        if (*slot != NULL && check(*slot, "local free"))
+        {
+            alloc->free(*slot);
+            ++ops;
+        }
+        size_t size = 16 + (r >> 8) % 241;
+        if ((*slot = alloc->malloc(size)) != NULL) stamp(*slot, size);
+        ++ops;
+    }
+    for (int i = 0; i < WORKING_SET; ++i)
+    {
+        if (live[i] != NULL && check(live[i], "local free")) alloc->free(live[i]);
+    }
+    w->end = now();
+    w->ops = ops;
+    return NULL;
+}
+
+// Posts new blocks to the next thread's mailbox and frees or reallocs what arrives in its own
+static void *cross_worker(void *arg)
+{
+    worker_t *w = arg;
+    const allocator_t *alloc = w->alloc;
+    uint32_t state = 2654435761u * (w->id + 1);
+    mailbox_t *out = &mailboxes[(w->id + 1) % w->nthreads];
+    mailbox_t *in = &mailboxes[w->id];
+
+    pthread_barrier_wait(&start_line);
+    w->start = now();
+    long ops = 0;
+    while (ops < ops_per_thread)
+    {
+        uint32_t r = next_random(&state);
+        size_t size = (r >> 24) < 16 ? 16 + (r >> 8) % 4081 : 16 + (r >> 8) % 241;
+        unsigned char *p = alloc->malloc(size);
+        ++ops;
+        if (p == NULL) continue;
+        stamp(p, size);
+
+        // A block the next thread has not picked up yet is freed by its sender
+        unsigned char *old =
+            __atomic_exchange_n(&out->slot[r % MAILBOX_SLOTS], p, __ATOMIC_ACQ_REL);
+        if (old != NULL && check(old, "unclaimed free"))
+        {
+            alloc->free(old);
+            ++ops;
+        }
+
+        unsigned char *mine =
+            __atomic_exchange_n(&in->slot[(r >> 16) % MAILBOX_SLOTS], NULL, __ATOMIC_ACQ_REL);
+        if (mine == NULL || !check(mine, "remote free")) continue;
+        if (r & 1)
+        {
+            alloc->free(mine);
+        }
+        else
+        {
+            size_t old_size = *(size_t *)mine;
+            size_t new_size = 16 + (r >> 4) % 4081;
+            unsigned char *q = alloc->realloc(mine, new_size);
+            if (q != NULL)
+            {
+                // The first word survives any resize, and the tag whenever the block grew
+                if (*(size_t *)q != old_size ||
+                    (new_size >= old_size && q[old_size - 1] != (unsigned char)old_size))
+                {
+                    fprintf(stderr, "remote realloc: contents lost at %p\n", (void *)q);
+                    __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+                }
+                alloc->free(q);
+                ++ops;
+            }
+        }
+        ++ops;
+    }
+    w->end = now();
+    w->ops = ops;
+    return NULL;
+}
+
+// Frees the blocks left in the mailboxes once all threads of a run are done
+static void drain_mailboxes(const allocator_t *alloc, int nthreads)
+{
+    for (int i = 0; i < nthreads; ++i)
+    {
+        for (int s = 0; s < MAILBOX_SLOTS; ++s)
+        {
+            unsigned char *p = mailboxes[i].slot[s];
+            mailboxes[i].slot[s] = NULL;
+            if (p != NULL && check(p, "final free")) alloc->free(p);
+        }
+    }
+}
+
+// Records size in the first word of a block and a tag derived from it in the last byte
+static void stamp(unsigned char *p, size_t size)
+{
+    *(size_t *)p = size;
+    p[size - 1] = (unsigned char)size;
+}
+
+// Returns 1 if a stamped block is intact; otherwise counts and reports it and returns 0, so the
+// block is leaked rather than handed back to a heap it may have damaged
+static int check(const unsigned char *p, const char *what)
+{
+    size_t size = *(const size_t *)p;
+    if (size >= 16 && size <= 4096 && p[size - 1] == (unsigned char)size) return 1;
+    fprintf(stderr, "%s: block at %p is corrupted\n", what, (const void *)p);
+    __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// xorshift32
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
@@ -0,0 +1,164 @@
+/*
+ * pmr_bench.cpp - Container throughput on the mm memory resources and STL allocator against the
+ * default resource (operator new over the C library malloc).
+ *
+ * Each workload runs a fixed number of rounds on std::vector, std::map and std::unordered_map,
+ * and the best round is reported in nanoseconds per element. The allocator runs over real
+ * memory (memlib.c built with MEM_OS), not the simulated heap.
+ *
+ * usage: pmr_bench [-n elements] [-r rounds]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+extern "C"
+{
+#include "memlib.h"
+}
+#include "mm_pmr.h"
+
+static std::size_t elements = 100000;
+static int rounds = 5;
+
+// Workloads on a memory resource; reset runs between rounds, outside the timing
+static void vector_push(std::pmr::memory_resource *resource);
+static void map_churn(std::pmr::memory_resource *resource);
+static void unordered_churn(std::pmr::memory_resource *resource);
+template <template <typename> class Alloc>
+static void map_churn_with();
+template <template <typename> class Alloc>
+static void unordered_churn_with();
+
+static double best_ns(const std::function<void()> &work, const std::function<void()> &reset);
+static std::size_t key(std::size_t i) { return (i * 2654435761u) % (elements * 4); }
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        if (c == 'n')
+            elements = std::strtoul(optarg, nullptr, 10);
+        else if (c == 'r')
+            rounds = std::atoi(optarg);
+        else
+        {
+            std::fprintf(stderr, "usage: %s [-n elements] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (elements == 0 || rounds <= 0) return 1;
+
+    mem_init();
+    if (mm_init() < 0)
+    {
+        std::fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    mm::arena_resource arena;
+    mm::pool_resource pool;
+    struct
+    {
+        const char *name;
+        std::pmr::memory_resource *resource;
+        std::function<void()> reset;
+    } resources[] = {
+        {"default", std::pmr::new_delete_resource(), [] {}},
+        {"mm::heap", mm::heap(), [] {}},
+        {"mm::pool", &pool, [] {}},
+        {"mm::arena", &arena, [&arena] { arena.release(); }},
+    };
+
+    std::printf("%zu elements, best of %d rounds, ns per element\n\n", elements, rounds);
+    std::printf("%-16s %12s %12s %14s\n", "resource", "vector", "map", "unordered_map");
+    for (auto &r : resources)
+    {
+        double v = best_ns([&] { vector_push(r.resource); }, r.reset);
+        double m = best_ns([&] { map_churn(r.resource); }, r.reset);
+        double u = best_ns([&] { unordered_churn(r.resource); }, r.reset);
+        std::printf("%-16s %12.1f %12.1f %14.1f\n", r.name, v, m, u);
+    }
+
+    std::printf("%-16s %12s %12.1f %14.1f\n", "std::allocator", "-",
+                best_ns(map_churn_with<std::allocator>, [] {}),
+                best_ns(unordered_churn_with<std::allocator>, [] {}));
+    std::printf("%-16s %12s %12.1f %14.1f\n", "mm::allocator", "-",
+                best_ns(map_churn_with<mm::allocator>, [] {}),
+                best_ns(unordered_churn_with<mm::allocator>, [] {}));
+    return 0;
+}
+
+/*
+ * Static Helper Functions
+ */
+
+// Grows many short vectors element by element, so every growth reallocates
+static void vector_push(std::pmr::memory_resource *resource)
+{
+    for (std::size_t done = 0; done < elements; done += 100)
+    {
+        std::pmr::vector<std::size_t> v(resource);
+        for (std::size_t i = 0; i < 100; ++i) v.push_back(i);
+    }
+}
+
+// Inserts every key, then erases half and inserts them again, then tears the map down
+static void map_churn(std::pmr::memory_resource *resource)
+{
+    std::pmr::map<std::size_t, std::size_t> m(resource);
+    for (std::size_t i = 0; i < elements; ++i) m.emplace(key(i), i);
+    for (std::size_t i = 0; i < elements; i += 2) m.erase(key(i));
+    for (std::size_t i = 0; i < elements; i += 2) m.emplace(key(i), i);
+}
+
+static void unordered_churn(std::pmr::memory_resource *resource)
+{
+    std::pmr::unordered_map<std::size_t, std::size_t> m(resource);
+    for (std::size_t i = 0; i < elements; ++i) m.emplace(key(i), i);
+    for (std::size_t i = 0; i < elements; i += 2) m.erase(key(i));
+    for (std::size_t i = 0; i < elements; i += 2) m.emplace(key(i), i);
+}
+
+template <template <typename> class Alloc>
+static void map_churn_with()
+{
+    using value = std::pair<const std::size_t, std::size_t>;
+    std::map<std::size_t, std::size_t, std::less<std::size_t>, Alloc<value>> m;
+    for (std::size_t i = 0; i < elements; ++i) m.emplace(key(i), i);
+    for (std::size_t i = 0; i < elements; i += 2) m.erase(key(i));
+    for (std::size_t i = 0; i < elements; i += 2) m.emplace(key(i), i);
+}
+
+template <template <typename> class Alloc>
+static void unordered_churn_with()
+{
+    using value = std::pair<const std::size_t, std::size_t>;
+    std::unordered_map<std::size_t, std::size_t, std::hash<std::size_t>,
+                       std::equal_to<std::size_t>, Alloc<value>>
+        m;
+    for (std::size_t i = 0; i < elements; ++i) m.emplace(key(i), i);
+    for (std::size_t i = 0; i < elements; i += 2) m.erase(key(i));
+    for (std::size_t i = 0; i < elements; i += 2) m.emplace(key(i), i);
+}
+
+// Runs work once per round and returns the fastest round in ns per element
+static double best_ns(const std::function<void()> &work, const std::function<void()> &reset)
+{
+    double best = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        reset();
+        if (r == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+    return best / elements;
+}
@@ -0,0 +1,248 @@
+/*
+ * policy_bench.cpp - Replays the mdriver traces on every combination of the policies in
+ * mm_policy.h and reports utilization and throughput for each.
+ *
+ * Utilization is the peak of the live payload over the peak heap size, averaged over the traces
+ * as mdriver does; throughput is operations per second over all traces. Payloads are tagged at
+ * both ends and checked when they are freed or reallocated, so a combination that corrupts the
+ * heap is reported instead of timed.
+ *
+ * usage: policy_bench [-t tracedir] [-f tracefile] [-r repeats]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "config.h"
+#include "mm_policy.h"
+
+namespace
+{
+
+struct op
+{
+    char type;  // 'a', 'r' or 'f'
+    unsigned id;
+    std::size_t size;
+};
+
+struct trace
+{
+    std::string name;
+    unsigned num_ids = 0;
+    std::vector<op> ops;
+};
+
+struct result
+{
+    double util = 0;  // summed over traces
+    double secs = 0;
+    std::size_t ops = 0;
+    bool ok = true;
+};
+
+template <typename... T>
+struct type_list
+{
+};
+
+// The policies combined; every combination becomes its own allocator_core instantiation
+using headers = type_list<mm::narrow_header, mm::wide_header>;
+using class_policies = type_list<mm::exact_then_log2<8, 64, 14>, mm::log2_classes<4, 20>>;
+using fit_policies = type_list<mm::first_fit, mm::best_fit, mm::next_fit>;
+using split_policies = type_list<mm::always_split, mm::split_above<64>>;
+
+mem_heap_t *heap;
+std::vector<trace> traces;
+int repeats = 3;
+
+bool read_trace(const std::string &path, trace &t);
+template <typename Core>
+bool replay(Core &core, const trace &t, std::size_t &peak_live);
+template <typename Core>
+void run();
+
+// Expand the policy lists into every combination, one instantiation each
+template <typename H, typename C, typename F, typename... S>
+void run_splits(type_list<S...>)
+{
+    (run<mm::allocator_core<H, C, F, S>>(), ...);
+}
+
+template <typename H, typename C, typename... F>
+void run_fits(type_list<F...>)
+{
+    (run_splits<H, C, F>(split_policies{}), ...);
+}
+
+template <typename H, typename... C>
+void run_classes(type_list<C...>)
+{
+    (run_fits<H, C>(fit_policies{}), ...);
+}
+
+template <typename... H>
+void run_all(type_list<H...>)
+{
+    (run_classes<H>(class_policies{}), ...);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    static const char *default_tracefiles[] = {DEFAULT_TRACEFILES, nullptr};
+    std::string dir = TRACEDIR;
+    std::vector<std::string> files;
+    int c;
+    while ((c = getopt(argc, argv, "t:f:r:")) != -1)
+    {
+        if (c == 't')
+            dir = std::string(optarg) + "/";
+        else if (c == 'f')
+            files.push_back(optarg);
+        else if (c == 'r')
+            repeats = std::atoi(optarg);
+        else
+        {
+            std::fprintf(stderr, "usage: %s [-t tracedir] [-f tracefile] [-r repeats]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (files.empty())
+    {
+        for (const char **f = default_tracefiles; *f != nullptr; ++f) files.push_back(dir + *f);
+    }
+    if (repeats <= 0) return 1;
+
+    for (const std::string &f : files)
+    {
+        trace t;
+        if (!read_trace(f, t))
+        {
+            std::fprintf(stderr, "could not read trace %s\n", f.c_str());
+            return 1;
+        }
+        traces.push_back(std::move(t));
+    }
+    if ((heap = mem_heap_create(MAX_HEAP)) == nullptr)
+    {
+        std::fprintf(stderr, "could not reserve the heap\n");
+        return 1;
+    }
+
+    std::printf("%zu traces, best of %d runs\n\n", traces.size(), repeats);
+    std::printf("%-42s %6s %10s\n", "header classes fit split", "util", "Kops");
+    run_all(headers{});
+
+    mem_heap_destroy(heap);
+    return 0;
+}
+
+namespace
+{
+
+// Reads a trace in mdriver's format: four header numbers, then one operation per line
+bool read_trace(const std::string &path, trace &t)
+{
+    FILE *f = std::fopen(path.c_str(), "r");
+    if (f == nullptr) return false;
+    int sugg_heapsize, num_ops, weight;
+    bool ok = std::fscanf(f, "%d %u %d %d", &sugg_heapsize, &t.num_ids, &num_ops, &weight) == 4;
+    char type[2];
+    while (ok && std::fscanf(f, "%1s", type) == 1)
+    {
+        op o = {type[0], 0, 0};
+        if (o.type == 'a' || o.type == 'r')
+            ok = std::fscanf(f, "%u %zu", &o.id, &o.size) == 2;
+        else if (o.type == 'f')
+            ok = std::fscanf(f, "%u", &o.id) == 1;
+        else
+            ok = false;
+        if (ok && o.id >= t.num_ids) ok = false;
+        t.ops.push_back(o);
+    }
+    std::fclose(f);
+    std::size_t slash = path.find_last_of('/');
+    t.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return ok;
+}
+
+unsigned char tag(unsigned id) { return static_cast<unsigned char>(id * 131 + 7); }
+
+// Runs a trace on a fresh heap; returns false if a payload was misplaced or overwritten
+template <typename Core>
+bool replay(Core &core, const trace &t, std::size_t &peak_live)
+{
+    if (core.init() < 0) return false;
+    std::vector<unsigned char *> ptrs(t.num_ids, nullptr);
+    std::vector<std::size_t> sizes(t.num_ids, 0);
+    char *lo = static_cast<char *>(mem_heap_base(heap));
+    std::size_t live = 0;
+    peak_live = 0;
+
+    for (const op &o : t.ops)
+    {
+        unsigned char *p = ptrs[o.id];
+        if (p != nullptr && (p[0] != tag(o.id) || p[sizes[o.id] - 1] != tag(o.id))) return false;
+        if (o.type == 'f')
+        {
+            core.free(p);
+            live -= sizes[o.id];
+            ptrs[o.id] = nullptr;
+            sizes[o.id] = 0;
+            continue;
+        }
+
+        p = static_cast<unsigned char *>(o.type == 'a' ? core.malloc(o.size)
+                                                       : core.realloc(p, o.size));
+        if (o.size == 0) continue;
+        if (p == nullptr || reinterpret_cast<std::uintptr_t>(p) % Core::alignment != 0)
+            return false;
+        if (reinterpret_cast<char *>(p) < lo ||
+            reinterpret_cast<char *>(p) + o.size > lo + mem_heap_size(heap))
+            return false;
+        live += o.size - sizes[o.id];
+        peak_live = std::max(peak_live, live);
+        ptrs[o.id] = p;
+        sizes[o.id] = o.size;
+        p[0] = p[o.size - 1] = tag(o.id);
+    }
+    return true;
+}
+
+// Replays every trace on one combination and prints its row
+template <typename Core>
+void run()
+{
+    Core core(heap);
+    result r;
+    for (const trace &t : traces)
+    {
+        std::size_t peak_live = 0;
+        double best = 0;
+        for (int i = 0; i < repeats && r.ok; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            r.ok = replay(core, t, peak_live);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (i == 0 || elapsed.count() < best) best = elapsed.count();
+        }
+        if (!r.ok)
+        {
+            std::printf("%-42s failed on %s\n", Core::name().c_str(), t.name.c_str());
+            return;
+        }
+        std::size_t peak_heap = mem_heap_peak(heap);
+        r.util += peak_heap != 0 ? static_cast<double>(peak_live) / peak_heap : 0;
+        r.secs += best;
+        r.ops += t.ops.size();
+    }
+    std::printf("%-42s %5.0f%% %10.0f\n", Core::name().c_str(), 100 * r.util / traces.size(),
+                r.ops / r.secs / 1e3);
+}
+
+}  // namespace